@@ -0,0 +1,782 @@
+//Image Filter Benchmarks
+//
+//  benchmark.cpp
+//  Assignment1
+//
+//  Times the filters in image.cpp against the sample images. Not part of the
+//  Xcode target; build it on its own with every source but main.cpp, using
+//  the g++ line in README.md.
+
+
+#include "image.h"
+#include "parallel.h"
+#include "chain.h"
+#include "warp.h"
+#include "bufferpool.h"
+#include <atomic>
+#include <new>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+
+#define STB_IMAGE_IMPLEMENTATION //only place once in one .cpp file
+#include "stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION //only place once in one .cpp files
+#include "stb_image_write.h"
+
+
+using namespace std;
+
+
+/**
+ * Heap allocation count, for the allocations mode: every operator new in the
+ * program, on any thread, goes through here.  Kept out of line so the
+ * compiler doesn't pair an inlined free with the library's operator new.
+ **/
+static atomic<long long> heap_allocations(0);
+
+__attribute__((noinline)) void* operator new(size_t bytes)
+{
+	heap_allocations++;
+	void *p = malloc(bytes > 0 ? bytes : 1);
+	if (p == NULL)
+		throw bad_alloc();
+	return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+
+/**
+ * prototypes
+ **/
+static void ShowUsage(void);
+static double Seconds(void);
+static void ReferenceBlur(Image *img, int n, double sigma);
+static void BenchBlur(int argc, char *argv[]);
+static void BenchThreads(int argc, char *argv[]);
+static void BenchKernels(int, char *[]);
+static void BenchFilters(int argc, char *argv[]);
+static void BenchGeometry(int argc, char *argv[]);
+static void BenchAllocations(int argc, char *argv[]);
+static void BenchFastPaths(int argc, char *argv[]);
+
+static char default_images[][32] = {
+	"sample_images/FerrisWheel.jpg",
+	"sample_images/JellyFish.jpg",
+	"sample_images/Ray.jpg",
+	"sample_images/black.jpg",
+	"sample_images/cube.jpg",
+	"sample_images/hopkins.jpg",
+	"sample_images/millcity.jpg",
+	"sample_images/splash.jpg",
+	"sample_images/sun.jpg",
+	"sample_images/sunzoom.png",
+	"sample_images/yellow.png",
+};
+static const int num_default_images = sizeof(default_images) / sizeof(default_images[0]);
+
+
+int main( int argc, char* argv[] ){
+	// first argument is program name
+	argv++, argc--;
+
+	if (argc == 0) {
+		ShowUsage();
+	}
+
+	if (!strcmp(*argv, "blur"))
+	{
+		BenchBlur(argc - 1, argv + 1);
+	}
+	else if (!strcmp(*argv, "threads"))
+	{
+		BenchThreads(argc - 1, argv + 1);
+	}
+	else if (!strcmp(*argv, "kernels"))
+	{
+		BenchKernels(argc - 1, argv + 1);
+	}
+	else if (!strcmp(*argv, "filters"))
+	{
+		BenchFilters(argc - 1, argv + 1);
+	}
+	else if (!strcmp(*argv, "geometry"))
+	{
+		BenchGeometry(argc - 1, argv + 1);
+	}
+	else if (!strcmp(*argv, "allocations"))
+	{
+		BenchAllocations(argc - 1, argv + 1);
+	}
+	else if (!strcmp(*argv, "fastpaths"))
+	{
+		BenchFastPaths(argc - 1, argv + 1);
+	}
+	else
+	{
+		fprintf(stderr, "benchmark: invalid mode: %s\n", *argv);
+		ShowUsage();
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+/**
+ * ShowUsage
+ **/
+static char modes[] =
+"blur [image ...]      separable Image::Blur against a direct n x n convolution\n"
+"threads [image]       each filter on 1, 2, 4, 8 and 16 threads, checking the output matches\n"
+"kernels               pixels/second of the span kernels in pixel.h against the per-pixel versions\n"
+"filters [option ...] [image ...]\n"
+"                      median and p95 time of every public Image method, as CSV or JSON\n"
+"    -warmup <n>       untimed runs before timing each method (default 1)\n"
+"    -reps <n>         timed runs of each method (default 5)\n"
+"    -mp <n,n,...>     sizes of the synthetic images in megapixels (default 1,12,48, 0 for none)\n"
+"    -json             JSON instead of CSV\n"
+"geometry [image]      2, 3, 4 and 8 step crop/scale/rotate chains, point and bilinear, fused into one warp\n"
+"                      against one step at a time\n"
+"allocations [image]   heap allocations, new pixel buffers and pool misses of each step of a chain run a step\n"
+"                      at a time; fails if a step goes over its pixel buffer budget or misses the pool\n"
+"fastpaths [image]     Affine's point and bilinear scale paths against WarpAffine; fails if any pixel differs\n"
+;
+
+static void ShowUsage(void)
+{
+	fprintf(stderr, "Usage: benchmark <mode> [arg ...]\n");
+	fprintf(stderr, "%s", modes);
+	fprintf(stderr, "Images default to the files in sample_images/.\n");
+	exit(EXIT_FAILURE);
+}
+
+
+/**
+ * Seconds - monotonic wall clock
+ **/
+static double Seconds(void)
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/**
+ * ReferenceBlur - the n * n taps per pixel cost model Blur had before it was made separable.
+ * Uses the same kernel, so its output matches Blur to within rounding.
+ **/
+static void ReferenceBlur(Image *img, int n, double sigma)
+{
+	int radius = n / 2;
+	if (sigma <= 0.0)
+		sigma = max(1.0, radius / 3.0);
+
+	vector<float> kernel(2 * radius + 1);
+	double total = 0.0;
+	for (int i = -radius; i <= radius; i++) {
+		kernel[i + radius] = exp(-1.0 * i * i / (2.0 * sigma * sigma));
+		total += kernel[i + radius];
+	}
+	for (size_t i = 0; i < kernel.size(); i++)
+		kernel[i] /= total;
+
+	const Image original(*img);
+	img->Unshare();
+	int w = img->Width(), h = img->Height();
+
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i++) {
+			float r = 0, g = 0, b = 0;
+			for (int l = -radius; l <= radius; l++) {
+				int y = min(max(j + l, 0), h - 1);
+				for (int k = -radius; k <= radius; k++) {
+					int x = min(max(i + k, 0), w - 1);
+					float weight = kernel[k + radius] * kernel[l + radius];
+					const Pixel &p = original.GetPixel(x, y);
+					r += weight * p.r;
+					g += weight * p.g;
+					b += weight * p.b;
+				}
+			}
+			img->GetPixel(i, j).Set(ComponentClamp((int) (r + 0.5f)), ComponentClamp((int) (g + 0.5f)), ComponentClamp((int) (b + 0.5f)));
+		}
+	}
+}
+
+
+/**
+ * BenchBlur
+ **/
+static void BenchBlur(int argc, char *argv[])
+{
+	static const int sizes[] = { 3, 7, 15, 31 };
+
+	printf("image,width,height,n,direct_ms,separable_ms,speedup,max_diff\n");
+
+	int count = argc > 0 ? argc : num_default_images;
+	for (int f = 0; f < count; f++) {
+		char *fname = argc > 0 ? argv[f] : default_images[f];
+		Image src(fname);
+
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			int n = sizes[s];
+			Image direct(src), separable(src);
+
+			double t0 = Seconds();
+			ReferenceBlur(&direct, n, 0.0);
+			double t1 = Seconds();
+			separable.Blur(n);
+			double t2 = Seconds();
+
+			int max_diff = 0;
+			for (int i = 0; i < src.NumPixels() * 4; i++)
+				max_diff = max(max_diff, abs(direct.data.raw[i] - separable.data.raw[i]));
+
+			printf("%s,%d,%d,%d,%.2f,%.2f,%.1f,%d\n", fname, src.Width(), src.Height(), n,
+			       (t1 - t0) * 1000.0, (t2 - t1) * 1000.0, (t1 - t0) / (t2 - t1), max_diff);
+		}
+	}
+}
+
+
+/**
+ * BenchThreads
+ **/
+// Runs one filter on img, leaving the result in it
+static void RunFilter(Image *img, int filter)
+{
+	switch (filter) {
+		case 0: img->Brighten(1.2); break;
+		case 1: img->ChangeContrast(1.5); break;
+		case 2: img->ChangeSaturation(1.5); break;
+		case 3: img->Quantize(4); break;
+		case 4: img->Blur(9); break;
+		case 5: img->EdgeDetect(); break;
+		case 6: *img = img->Scale(0.7, 0.7); break;
+		case 7: *img = img->Rotate(0.5); break;
+	}
+}
+
+// True if a and b are the same size with the same pixels, compared row by row since a crop is a view with its source's stride
+static bool SamePixels(const Image& a, const Image& b)
+{
+	if (a.Width() != b.Width() || a.Height() != b.Height())
+		return false;
+	for (int j = 0; j < a.Height(); j++) {
+		if (memcmp(a.Row(j), b.Row(j), a.Width() * sizeof(Pixel)))
+			return false;
+	}
+	return true;
+}
+
+static void BenchThreads(int argc, char *argv[])
+{
+	static const char *filters[] = { "Brighten", "ChangeContrast", "ChangeSaturation", "Quantize", "Blur", "EdgeDetect", "Scale", "Rotate" };
+	static const int threads[] = { 1, 2, 4, 8, 16 };
+	static const int reps = 5;
+
+	// upscaled so every filter has a few megapixels to chew on
+	Image loaded(argc > 0 ? argv[0] : default_images[0]);
+	Image src = loaded.Scale(2.0, 2.0);
+
+	printf("filter,threads,ms,speedup,identical\n");
+
+	for (int f = 0; f < (int) (sizeof(filters) / sizeof(filters[0])); f++) {
+		Image *reference = NULL;
+		double base = 0.0;
+
+		for (int t = 0; t < (int) (sizeof(threads) / sizeof(threads[0])); t++) {
+			SetThreadCount(threads[t]);
+
+			double best = 1e30;
+			Image *img = NULL;
+			for (int r = 0; r < reps; r++) {
+				delete img;
+				img = new Image(src);
+
+				double t0 = Seconds();
+				RunFilter(img, f);
+				best = min(best, Seconds() - t0);
+			}
+
+			if (reference == NULL) {
+				reference = img;
+				base = best;
+				img = NULL;
+			}
+
+			bool identical = img == NULL || SamePixels(*img, *reference);
+			printf("%s,%d,%.2f,%.2f,%s\n", filters[f], threads[t], best * 1000.0, base / best, identical ? "yes" : "NO");
+			delete img;
+		}
+		delete reference;
+	}
+}
+
+
+/**
+ * BenchKernels
+ **/
+static int MaxDifference(const Pixel *a, const Pixel *b, int count)
+{
+	const uint8_t *p = (const uint8_t *) a, *q = (const uint8_t *) b;
+	int max_diff = 0;
+	for (int i = 0; i < count * 4; i++)
+		max_diff = max(max_diff, abs(p[i] - q[i]));
+	return max_diff;
+}
+
+static void BenchKernels(int, char *[])
+{
+	// a row a bit bigger than the caches, repeated enough to time
+	static const int count = 1 << 20;
+	static const int reps = 20;
+
+	vector<Pixel> p(count), q(count), span(count), scalar(count);
+	for (int i = 0; i < count; i++) {
+		p[i] = PixelRandom();
+		q[i] = PixelRandom();
+	}
+
+	static const char *kernels[] = { "LerpSpan t=0.3", "LerpSpan t=2", "ScaleSpan f=1.7" };
+
+	printf("kernel,span_mpix_per_s,scalar_mpix_per_s,speedup,max_diff\n");
+
+	for (int k = 0; k < (int) (sizeof(kernels) / sizeof(kernels[0])); k++) {
+		double t0 = Seconds();
+		for (int r = 0; r < reps; r++) {
+			switch (k) {
+				case 0: LerpSpan(&p[0], &q[0], &span[0], count, 0.3); break;
+				case 1: LerpSpan(&p[0], &q[0], &span[0], count, 2.0); break;
+				case 2: ScaleSpan(&p[0], &span[0], count, 1.7); break;
+			}
+		}
+		double t1 = Seconds();
+		for (int r = 0; r < reps; r++) {
+			for (int i = 0; i < count; i++) {
+				switch (k) {
+					case 0: scalar[i] = PixelLerp(p[i], q[i], 0.3); break;
+					case 1: scalar[i] = PixelLerp(p[i], q[i], 2.0); break;
+					case 2: scalar[i] = p[i] * 1.7; break;
+				}
+			}
+		}
+		double t2 = Seconds();
+
+		double pixels = (double) count * reps / 1e6;
+		printf("%s,%.1f,%.1f,%.1f,%d\n", kernels[k], pixels / (t1 - t0), pixels / (t2 - t1),
+		       (t2 - t1) / (t1 - t0), MaxDifference(&span[0], &scalar[0], count));
+	}
+}
+
+
+/**
+ * BenchFilters
+ **/
+static const char *methods[] = {
+	"AddNoise", "Brighten", "MeanLuminance", "ChangeContrast", "ChangeSaturation", "Crop", "ExtractChannel",
+	"Quantize", "RandomDither", "Blur", "Sharpen", "EdgeDetect", "OrderedDither", "FloydSteinbergDither",
+	"Scale", "Rotate", "Fun", "Sample", "Equalize", "AutoLevels",
+	"ScaleBilinear", "ScaleLanczos3", "Rotate90", "AffineBilinear",
+};
+static const int num_methods = sizeof(methods) / sizeof(methods[0]);
+
+// Runs one public method on img with typical arguments. Whatever it returns is thrown away,
+// apart from a checksum so the compiler can't drop the work
+static int RunMethod(Image *img, int method)
+{
+	Image result;
+	int checksum = 0;
+
+	switch (method) {
+		case 0: img->AddNoise(0.2); break;
+		case 1: img->Brighten(1.2); break;
+		case 2: checksum = (int) img->MeanLuminance(); break;
+		case 3: img->ChangeContrast(1.5); break;
+		case 4: img->ChangeSaturation(1.5); break;
+		case 5: result = img->Crop(img->Width() / 4, img->Height() / 4, img->Width() / 2, img->Height() / 2); break;
+		case 6: img->ExtractChannel(IMAGE_CHANNEL_GREEN); break;
+		case 7: img->Quantize(4); break;
+		case 8: img->RandomDither(4); break;
+		case 9: img->Blur(9); break;
+		case 10: img->Sharpen(9); break;
+		case 11: img->EdgeDetect(); break;
+		case 12: img->OrderedDither(4); break;
+		case 13: img->FloydSteinbergDither(4); break;
+		case 14: result = img->Scale(0.7, 0.7); break;
+		case 15: result = img->Rotate(0.5); break;
+		case 16: img->Fun(); break;
+		case 17:
+			for (int j = 0; j < img->Height(); j++)
+				for (int i = 0; i < img->Width(); i++)
+					checksum += img->Sample(i + 0.5, j + 0.5).g;
+			break;
+		case 18: img->Equalize(); break;
+		case 19: img->AutoLevels(); break;
+		case 20:
+			img->SetSamplingMethod(IMAGE_SAMPLING_BILINEAR);
+			result = img->Scale(0.7, 0.7);
+			break;
+		case 21: result = img->Scale(0.7, 0.7, IMAGE_FILTER_LANCZOS3); break;
+		case 22: result = img->Rotate(M_PI / 2); break;
+		case 23: {
+			// a slight turn and shear, so none of Affine's special cases apply
+			double m[6] = { 0.9, 0.2, 0, -0.15, 0.95, 0.1 * img->Height() };
+			img->SetSamplingMethod(IMAGE_SAMPLING_BILINEAR);
+			result = img->Affine(m);
+			break;
+		}
+	}
+
+	// read through a const reference, since a crop shares its pixels
+	const Image& out = result;
+	if (out.Width() > 0)
+		checksum = out.GetPixel(0, 0).g;
+	return checksum;
+}
+
+// A deterministic test image of about megapixels million pixels at 4:3 - gradients with some noise,
+// so nothing about it is unusually cheap for the filters
+static Image *SyntheticImage(double megapixels)
+{
+	int w = (int) (sqrt(megapixels * 1e6 * 4.0 / 3.0) + 0.5);
+	int h = (int) (megapixels * 1e6 / w + 0.5);
+	Image *img = new Image(w, h);
+
+	unsigned seed = 1;
+	for (int j = 0; j < h; j++) {
+		Pixel *row = img->Row(j);
+		for (int i = 0; i < w; i++) {
+			seed = seed * 1103515245 + 12345;
+			int noise = (seed >> 16) % 32 - 16;
+			row[i] = Pixel(ComponentClamp(i * 255 / w + noise), ComponentClamp(j * 255 / h + noise),
+			               ComponentClamp((i + j) * 255 / (w + h) - noise), 255);
+		}
+	}
+	return img;
+}
+
+// Value at fraction p of the sorted times, nearest rank
+static double Percentile(vector<double> times, double p)
+{
+	sort(times.begin(), times.end());
+	int rank = (int) ceil(p * times.size()) - 1;
+	return times[min(max(rank, 0), (int) times.size() - 1)];
+}
+
+static void BenchFilters(int argc, char *argv[])
+{
+	int warmup = 1, reps = 5;
+	bool json = false;
+	vector<double> sizes = { 1, 12, 48 };
+
+	while (argc > 0 && **argv == '-') {
+		if (!strcmp(*argv, "-warmup") && argc > 1) {
+			warmup = max(atoi(argv[1]), 0);
+			argv += 2, argc -= 2;
+		} else if (!strcmp(*argv, "-reps") && argc > 1) {
+			reps = max(atoi(argv[1]), 1);
+			argv += 2, argc -= 2;
+		} else if (!strcmp(*argv, "-mp") && argc > 1) {
+			sizes.clear();
+			for (char *s = strtok(argv[1], ","); s != NULL; s = strtok(NULL, ","))
+				if (atof(s) > 0)
+					sizes.push_back(atof(s));
+			argv += 2, argc -= 2;
+		} else if (!strcmp(*argv, "-json")) {
+			json = true;
+			argv++, argc--;
+		} else {
+			fprintf(stderr, "benchmark: invalid filters option: %s\n", *argv);
+			ShowUsage();
+		}
+	}
+
+	// the files first, then the synthetic sizes
+	int num_files = argc > 0 ? argc : num_default_images;
+	int num_sources = num_files + (int) sizes.size();
+
+	if (json)
+		printf("{\"threads\": %d, \"warmup\": %d, \"reps\": %d, \"results\": [\n", ThreadCount(), warmup, reps);
+	else
+		printf("image,width,height,method,reps,median_ms,p95_ms,mpix_per_s\n");
+
+	bool first = true;
+	for (int f = 0; f < num_sources; f++) {
+		char name[64];
+		Image *src;
+		if (f < num_files) {
+			src = new Image(argc > 0 ? argv[f] : default_images[f]);
+			snprintf(name, sizeof(name), "%s", argc > 0 ? argv[f] : default_images[f]);
+		} else {
+			src = SyntheticImage(sizes[f - num_files]);
+			snprintf(name, sizeof(name), "synthetic_%gmp", sizes[f - num_files]);
+		}
+
+		for (int m = 0; m < num_methods; m++) {
+			vector<double> times;
+			Image *img = NULL;
+
+			for (int r = 0; r < warmup + reps; r++) {
+				// every run starts from a fresh copy, since most methods change the image in place
+				delete img;
+				img = new Image(*src);
+
+				double t0 = Seconds();
+				RunMethod(img, m);
+				double t1 = Seconds();
+				if (r >= warmup)
+					times.push_back(t1 - t0);
+			}
+			delete img;
+
+			double median = Percentile(times, 0.5), p95 = Percentile(times, 0.95);
+			double mpix = median > 0.0 ? src->NumPixels() / 1e6 / median : 0.0;
+
+			if (json)
+				printf("%s  {\"image\": \"%s\", \"width\": %d, \"height\": %d, \"method\": \"%s\", "
+				       "\"median_ms\": %.3f, \"p95_ms\": %.3f, \"mpix_per_s\": %.2f}",
+				       first ? "" : ",\n", name, src->Width(), src->Height(), methods[m], median * 1000.0, p95 * 1000.0, mpix);
+			else
+				printf("%s,%d,%d,%s,%d,%.3f,%.3f,%.2f\n", name, src->Width(), src->Height(), methods[m], reps,
+				       median * 1000.0, p95 * 1000.0, mpix);
+			first = false;
+			fflush(stdout);
+		}
+
+		delete src;
+	}
+
+	if (json)
+		printf("\n]}\n");
+}
+
+
+/**
+ * BenchGeometry
+ **/
+
+// Geometric chains of steps operations on a w x h image, each ending up around the size it started.
+// The 3 step one ends in a quarter turn, which RunChain keeps out of the fused warp
+static Chain GeometryChain(int steps, int w, int h)
+{
+	Chain chain;
+
+	if (steps == 2) {
+		chain.push_back(Operation(OP_SCALE, 0.5, 0.5));
+		chain.push_back(Operation(OP_ROTATE, 0.3));
+	} else if (steps == 3) {
+		chain.push_back(Operation(OP_CROP, w / 8, h / 8, w * 3 / 4, h * 3 / 4));
+		chain.push_back(Operation(OP_SCALE, 0.5, 0.5));
+		chain.push_back(Operation(OP_ROTATE, M_PI / 2));
+	} else if (steps == 4) {
+		chain.push_back(Operation(OP_CROP, w / 8, h / 8, w * 3 / 4, h * 3 / 4));
+		chain.push_back(Operation(OP_SCALE, 0.5, 0.5));
+		chain.push_back(Operation(OP_ROTATE, 0.3));
+		chain.push_back(Operation(OP_SCALE, 2.0, 2.0));
+	} else {
+		chain.push_back(Operation(OP_CROP, w / 8, h / 8, w * 3 / 4, h * 3 / 4));
+		chain.push_back(Operation(OP_SCALE, 0.7, 0.7));
+		chain.push_back(Operation(OP_ROTATE, 0.2));
+		chain.push_back(Operation(OP_SCALE, 1.3, 1.3));
+		chain.push_back(Operation(OP_ROTATE, -0.4));
+		chain.push_back(Operation(OP_AFFINE, 1.0, 0.2, 0.0, 0.0, 1.0, 0.0));
+		chain.push_back(Operation(OP_SCALE, 0.8, 0.8));
+		chain.push_back(Operation(OP_CROP, 0, 0, w / 2, h / 2));
+	}
+	return chain;
+}
+
+static double MeanDifference(const Image *a, const Image *b)
+{
+	double total = 0.0;
+	for (int j = 0; j < a->Height(); j++) {
+		const Pixel *pa = a->Row(j), *pb = b->Row(j);
+		for (int i = 0; i < a->Width(); i++)
+			total += abs(pa[i].r - pb[i].r) + abs(pa[i].g - pb[i].g) + abs(pa[i].b - pb[i].b);
+	}
+	return total / (3.0 * a->NumPixels());
+}
+
+static void BenchGeometry(int argc, char *argv[])
+{
+	static const int steps[] = { 2, 3, 4, 8 };
+	static const int samplings[] = { IMAGE_SAMPLING_POINT, IMAGE_SAMPLING_BILINEAR };
+	static const int reps = 5;
+
+	Image *src = argc > 0 ? new Image(argv[0]) : SyntheticImage(12);
+
+	printf("steps,sampling,mode,ms,mb_allocated,mean_difference\n");
+
+	for (int s = 0; s < (int) (sizeof(steps) / sizeof(steps[0])); s++) {
+		for (int m = 0; m < 2; m++) {
+			Chain chain = GeometryChain(steps[s], src->Width(), src->Height());
+			Image *results[2] = { NULL, NULL };
+
+			// mode 0 runs the whole chain, so RunChain fuses it; mode 1 runs each operation as a chain of its own
+			for (int mode = 0; mode < 2; mode++) {
+				vector<double> times;
+				long long bytes = 0;
+
+				for (int r = 0; r < reps; r++) {
+					Image *img = new Image(*src);
+					img->SetSamplingMethod(samplings[m]);
+
+					long long bytes0 = ImageBytesAllocated();
+					double t0 = Seconds();
+					if (mode == 0) {
+						RunChain(img, chain);
+					} else {
+						for (size_t i = 0; i < chain.size(); i++)
+							RunChain(img, Chain(1, chain[i]));
+					}
+					times.push_back(Seconds() - t0);
+					bytes = ImageBytesAllocated() - bytes0;
+
+					delete results[mode];
+					results[mode] = img;
+				}
+
+				double difference = mode == 0 ? 0.0 : MeanDifference(results[0], results[1]);
+				printf("%d,%s,%s,%.3f,%.1f,%.3f\n", steps[s], samplings[m] == IMAGE_SAMPLING_POINT ? "point" : "bilinear",
+				       mode == 0 ? "fused" : "stepwise", Percentile(times, 0.5) * 1000.0,
+				       bytes / 1e6, difference);
+				fflush(stdout);
+			}
+
+			delete results[0];
+			delete results[1];
+		}
+	}
+
+	delete src;
+}
+
+
+/**
+ * BenchAllocations
+ *
+ * Each step of the chain is a chain of its own, so nothing is fused and the
+ * image goes through RunChain once per step the way a stage of a longer
+ * chain does.  After the first run has filled the pool and the scratch
+ * memory, a step should allocate its output's pixel buffer and nothing else
+ * that's per pixel: the image moves from one step to the next, so there are
+ * no Image objects or pixel copies on the heap in between.  Exits with
+ * EXIT_FAILURE if, after the first run, a step makes more pixel buffers than
+ * its budget below or the pool has to go to the system for any of them.
+ **/
+static void BenchAllocations(int argc, char *argv[])
+{
+	static const int runs = 4;
+
+	Image src(argc > 0 ? argv[0] : default_images[0]);
+	int w = src.Width(), h = src.Height();
+
+	static const char *names[] = { "crop", "blur", "scale", "rotate", "sharpen", "edgeDetect" };
+
+	// pixel buffers each step may make: a crop is a view, blur writes new pixels because the image shares
+	// the source's, scale makes a mip level and its output, and rotate one image per shear
+	static const int budgets[] = { 0, 1, 2, 3, 1, 0 };
+	bool failed = false;
+
+	vector<Chain> steps;
+	steps.push_back(Chain(1, Operation(OP_CROP, w / 8, h / 8, w * 3 / 4, h * 3 / 4)));
+	steps.push_back(Chain(1, Operation(OP_BLUR, 5)));
+	steps.push_back(Chain(1, Operation(OP_SCALE, 0.5, 0.5)));
+	steps.push_back(Chain(1, Operation(OP_ROTATE, 0.3)));
+	steps.push_back(Chain(1, Operation(OP_SHARPEN, 3)));
+	steps.push_back(Chain(1, Operation(OP_EDGE_DETECT)));
+
+	printf("run,step,heap_allocations,pixel_buffers,pool_misses\n");
+
+	for (int r = 0; r < runs; r++) {
+		long long heap_run = heap_allocations, buffers_run = ImageBuffersAllocated(), misses_run = PoolStats().misses;
+		Image img(src);
+
+		for (size_t i = 0; i < steps.size(); i++) {
+			long long heap0 = heap_allocations, buffers0 = ImageBuffersAllocated(), misses0 = PoolStats().misses;
+			RunChain(&img, steps[i]);
+			long long buffers = ImageBuffersAllocated() - buffers0, misses = PoolStats().misses - misses0;
+			printf("%d,%s,%lld,%lld,%lld\n", r, names[i], heap_allocations - heap0, buffers, misses);
+
+			if (r > 0 && (buffers > budgets[i] || misses > 0)) {
+				fprintf(stderr, "allocations: %s made %lld pixel buffers (budget %d) with %lld pool misses\n",
+				        names[i], buffers, budgets[i], misses);
+				failed = true;
+			}
+		}
+
+		printf("%d,total,%lld,%lld,%lld\n", r, heap_allocations - heap_run,
+		       ImageBuffersAllocated() - buffers_run, PoolStats().misses - misses_run);
+		fflush(stdout);
+	}
+
+	if (failed)
+		exit(EXIT_FAILURE);
+}
+
+
+/**
+ * BenchFastPaths
+ *
+ * Affine hands plain scales to ScalePoint and ScaleBilinear instead of
+ * WarpAffine, so it has to get the same pixels from them; otherwise a scale
+ * would come out differently on its own than as part of a fused run.
+ * Scales stay above 1/2, so Affine doesn't switch to a mip level.
+ **/
+static void BenchFastPaths(int argc, char *argv[])
+{
+	static const double scales[][2] = { { 0.7, 0.7 }, { 0.55, 0.9 }, { 1.3, 1.3 }, { 2.0, 1.5 }, { 3.7, 0.6 } };
+	static const int samplings[] = { IMAGE_SAMPLING_POINT, IMAGE_SAMPLING_BILINEAR };
+
+	Image src(argc > 0 ? argv[0] : default_images[0]);
+	bool failed = false;
+
+	printf("sampling,sx,sy,ms_fast,ms_warp,differing_pixels,max_difference\n");
+
+	for (int s = 0; s < (int) (sizeof(scales) / sizeof(scales[0])); s++) {
+		for (int m = 0; m < 2; m++) {
+			double map[6] = { scales[s][0], 0, 0, 0, scales[s][1], 0 };
+			Image img(src);
+			img.SetSamplingMethod(samplings[m]);
+
+			double t0 = Seconds();
+			Image fast = img.Affine(map);
+			double t1 = Seconds();
+			Image warped(fast.Width(), fast.Height());
+			WarpAffine(img, map, samplings[m], warped);
+			double t2 = Seconds();
+
+			long long differing = 0;
+			int largest = 0;
+			for (int j = 0; j < fast.Height(); j++) {
+				const Pixel *a = ((const Image&) fast).Row(j), *b = ((const Image&) warped).Row(j);
+				int most = MaxDifference(a, b, fast.Width());
+				for (int i = 0; i < fast.Width(); i++)
+					differing += memcmp(&a[i], &b[i], sizeof(Pixel)) != 0;
+				largest = max(largest, most);
+			}
+
+			printf("%s,%.2f,%.2f,%.3f,%.3f,%lld,%d\n", samplings[m] == IMAGE_SAMPLING_POINT ? "point" : "bilinear",
+			       scales[s][0], scales[s][1], (t1 - t0) * 1000.0, (t2 - t1) * 1000.0, differing, largest);
+			failed = failed || differing > 0;
+		}
+	}
+
+	if (failed)
+		exit(EXIT_FAILURE);
+}
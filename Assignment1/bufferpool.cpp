@@ -0,0 +1,147 @@
+//
+//  bufferpool.cpp
+//  Assignment1
+//
+
+#include "bufferpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+
+/**
+ * Pool state
+ **/
+namespace {
+
+struct Pool
+{
+    mutex lock;                                 // guards everything below
+    map<size_t, vector<void*> > freeBuffers;    // by class size
+    BufferPoolStats stats;
+    long long limit;
+
+    Pool () : stats(), limit(DefaultLimit()) {}
+    ~Pool () { Trim(); }
+
+    static long long DefaultLimit ();
+
+    // Frees every held buffer; expects lock to be held
+    void Trim ();
+};
+
+long long Pool::DefaultLimit () {
+    const char *env = getenv("IMAGE_POOL_MB");
+    return (env != NULL ? atoll(env) : 512) << 20;
+}
+
+void Pool::Trim () {
+    for (auto i = freeBuffers.begin(); i != freeBuffers.end(); ++i) {
+        for (size_t j = 0; j < i->second.size(); j++) {
+            free(i->second[j]);
+        }
+    }
+    freeBuffers.clear();
+    stats.bytesHeld = 0;
+}
+
+Pool& ThePool () {
+    static Pool pool;
+    return pool;
+}
+
+}
+
+
+// Rounds bytes up to its size class: the next of 4 evenly spaced sizes from one power of two to the next
+static size_t ClassSize (size_t bytes) {
+    if (bytes <= POOL_ALIGNMENT) {
+        return POOL_ALIGNMENT;
+    }
+    
+    size_t power = POOL_ALIGNMENT;
+    while (power * 2 < bytes) {
+        power *= 2;
+    }
+    size_t step = power / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+
+void* PoolAllocate (size_t bytes) {
+    size_t size = ClassSize(bytes);
+    Pool& pool = ThePool();
+    
+    {
+        lock_guard<mutex> held(pool.lock);
+        pool.stats.bytesInUse += size;
+        
+        vector<void*>& buffers = pool.freeBuffers[size];
+        if (!buffers.empty()) {
+            void *buffer = buffers.back();
+            buffers.pop_back();
+            pool.stats.bytesHeld -= size;
+            pool.stats.hits++;
+            return buffer;
+        }
+        pool.stats.misses++;
+    }
+    
+    void *buffer = NULL;
+    if (posix_memalign(&buffer, POOL_ALIGNMENT, size) != 0) {
+        printf("Error allocating %zu bytes", size);
+        exit(-1);
+    }
+    return buffer;
+}
+
+
+void PoolRelease (void *buffer, size_t bytes) {
+    if (buffer == NULL) {
+        return;
+    }
+    
+    size_t size = ClassSize(bytes);
+    Pool& pool = ThePool();
+    
+    {
+        lock_guard<mutex> held(pool.lock);
+        pool.stats.bytesInUse -= size;
+        
+        if (pool.stats.bytesHeld + (long long) size <= pool.limit) {
+            pool.freeBuffers[size].push_back(buffer);
+            pool.stats.bytesHeld += size;
+            return;
+        }
+    }
+    
+    free(buffer);
+}
+
+
+void SetPoolLimit (long long limit) {
+    Pool& pool = ThePool();
+    lock_guard<mutex> held(pool.lock);
+    
+    pool.limit = limit >= 0 ? limit : Pool::DefaultLimit();
+    if (pool.stats.bytesHeld > pool.limit) {
+        pool.Trim();
+    }
+}
+
+
+void PoolTrim () {
+    Pool& pool = ThePool();
+    lock_guard<mutex> held(pool.lock);
+    pool.Trim();
+}
+
+
+BufferPoolStats PoolStats () {
+    Pool& pool = ThePool();
+    lock_guard<mutex> held(pool.lock);
+    return pool.stats;
+}
@@ -0,0 +1,45 @@
+//BufferPool.h
+//
+//Reuse of freed pixel buffers
+//
+//  Every Image gets its pixels from here.  A freed buffer is kept on a list
+//  for its size class instead of going back to the system, so the next image
+//  of about the same size (the next step of a chain, or the next image of a
+//  batch) gets it back without a page faulting allocation.  Size classes are
+//  four steps per power of two, so a buffer is at most 25% bigger than asked for.
+
+#ifndef BUFFERPOOL_INCLUDED
+#define BUFFERPOOL_INCLUDED
+
+#include <stddef.h>
+
+// Alignment of every buffer, enough for any SIMD load
+#define POOL_ALIGNMENT 64
+
+struct BufferPoolStats
+{
+    long long hits;         // allocations served from a freed buffer
+    long long misses;       // allocations that had to go to the system
+    long long bytesHeld;    // freed buffers kept for reuse
+    long long bytesInUse;   // buffers handed out and not yet released
+};
+
+// Returns an uninitialized buffer of at least bytes, aligned to POOL_ALIGNMENT
+void* PoolAllocate (size_t bytes);
+
+// Gives a buffer from PoolAllocate back, with the same size it was asked for with
+void PoolRelease (void *buffer, size_t bytes);
+
+/**
+ * Sets the most bytes of freed buffers the pool keeps; buffers released past
+ * that go back to the system.  limit < 0 uses the IMAGE_POOL_MB environment
+ * variable if it's set, and otherwise 512MB.  0 turns the pool off.
+ **/
+void SetPoolLimit (long long limit);
+
+// Frees every buffer the pool is holding
+void PoolTrim ();
+
+BufferPoolStats PoolStats ();
+
+#endif
@@ -0,0 +1,537 @@
+//
+//  chain.cpp
+//  Assignment1
+//
+
+#include "chain.h"
+#include "pointops.h"
+#include "floatimage.h"
+#include "rotate.h"
+#include "warp.h"
+#include "scratch.h"
+#include <assert.h>
+using namespace std;
+
+
+const char* OperationName (int type) {
+    static const char *names[OP_N_OPERATIONS] = {
+        "input", "output", "noise", "brightness", "contrast", "saturation", "crop", "extractChannel",
+        "quantize", "randomDither", "blur", "sharpen", "edgeDetect", "orderedDither",
+        "FloydSteinbergDither", "scale", "rotate", "fun", "sampling", "boxblur", "fastblur",
+        "histogram", "equalize", "autolevels", "affine"
+    };
+    assert(type >= 0 && type < OP_N_OPERATIONS);
+    return names[type];
+}
+
+
+bool IsPointOperation (int type) {
+    switch (type) {
+        case OP_BRIGHTNESS:
+        case OP_CONTRAST:
+        case OP_SATURATION:
+        case OP_EXTRACT_CHANNEL:
+        case OP_QUANTIZE:
+            return true;
+    }
+    return false;
+}
+
+
+bool IsGeometricOperation (const Operation& op) {
+    switch (op.type) {
+        case OP_CROP:
+        case OP_ROTATE:
+        case OP_AFFINE:
+            return true;
+            
+        case OP_SCALE:
+            // a filter has to see the image at the size it's given
+            return (int) op.args[2] == IMAGE_FILTER_NONE;
+    }
+    return false;
+}
+
+
+bool IsFloatOperation (int type) {
+    switch (type) {
+        case OP_BRIGHTNESS:
+        case OP_CONTRAST:
+        case OP_SATURATION:
+        case OP_EXTRACT_CHANNEL:
+        case OP_BLUR:
+        case OP_SHARPEN:
+            return true;
+    }
+    
+    // quantizing and dithering are all about 8 bit values, and the rest don't gain anything from float
+    return false;
+}
+
+
+// Adds a point operation to the pending run, whose operations are listed in run
+static void AddPointOperation (PointPipeline& pending, string& run, Image *img, const Operation& op, ChainProfile *profile) {
+    switch (op.type) {
+        case OP_BRIGHTNESS:
+            pending.Brighten(op.args[0]);
+            break;
+            
+        case OP_CONTRAST: {
+            // the mean has to come from the image as the earlier operations in the run leave it,
+            // so they get applied (measuring the mean along the way) and the contrast starts a new run
+            if (profile) profile->Begin(img);
+            float mean = pending.Empty() ? img->MeanLuminance() : pending.ApplyMeanLuminance(img);
+            if (profile) profile->End(run.empty() ? "mean" : run + "+mean", img);
+            
+            pending.Clear();
+            run.clear();
+            pending.ChangeContrast(op.args[0], mean);
+            break;
+        }
+            
+        case OP_SATURATION:
+            pending.ChangeSaturation(op.args[0]);
+            break;
+            
+        case OP_EXTRACT_CHANNEL:
+            pending.ExtractChannel((int) op.args[0]);
+            break;
+            
+        case OP_QUANTIZE:
+            pending.Quantize((int) op.args[0]);
+            break;
+    }
+    
+    run += run.empty() ? "" : "+";
+    run += OperationName(op.type);
+}
+
+
+// Applies the pending run of point operations and starts a new one
+static void FlushPointOperations (PointPipeline& pending, string& run, Image *img, ChainProfile *profile) {
+    if (pending.Empty()) {
+        return;
+    }
+    
+    if (profile) profile->Begin(img);
+    pending.Apply(img);
+    if (profile) profile->End(run, img);
+    
+    pending.Clear();
+    run.clear();
+}
+
+
+// Runs any other operation (or, for float chains, a point operation with no float version) on img.  The ones that
+// make a new image move it into img
+static void RunOperation (Image *img, const Operation& op) {
+    int sampling = img->sampling_method;
+    
+    switch (op.type) {
+        case OP_INPUT:
+            *img = Image(op.fname);
+            return;
+            
+        case OP_OUTPUT:
+            img->Write(op.fname);
+            break;
+            
+        case OP_NOISE:
+            img->AddNoise(op.args[0]);
+            break;
+            
+        case OP_QUANTIZE:
+            img->Quantize((int) op.args[0]);
+            break;
+            
+        case OP_CROP:
+            *img = img->Crop((int) op.args[0], (int) op.args[1], (int) op.args[2], (int) op.args[3]);
+            break;
+            
+        case OP_RANDOM_DITHER:
+            img->RandomDither((int) op.args[0]);
+            break;
+            
+        case OP_BLUR:
+            img->Blur((int) op.args[0], op.args[1]);
+            break;
+            
+        case OP_SHARPEN:
+            img->Sharpen((int) op.args[0]);
+            break;
+            
+        case OP_BOX_BLUR:
+            img->BoxBlur((int) op.args[0], (int) op.args[1]);
+            break;
+            
+        case OP_FAST_BLUR:
+            img->FastBlur(op.args[0]);
+            break;
+            
+        case OP_HISTOGRAM:
+            img->Stats().Write(op.fname);
+            break;
+            
+        case OP_EQUALIZE:
+            img->Equalize();
+            break;
+            
+        case OP_AUTOLEVELS:
+            img->AutoLevels(op.args[0]);
+            break;
+            
+        case OP_EDGE_DETECT:
+            img->EdgeDetect();
+            break;
+            
+        case OP_ORDERED_DITHER:
+            img->OrderedDither((int) op.args[0]);
+            break;
+            
+        case OP_FLOYD_STEINBERG_DITHER:
+            img->FloydSteinbergDither((int) op.args[0]);
+            break;
+            
+        case OP_SCALE:
+            *img = img->Scale(op.args[0], op.args[1], (int) op.args[2]);
+            break;
+            
+        case OP_ROTATE:
+            *img = img->Rotate(op.args[0]);
+            break;
+            
+        case OP_AFFINE:
+            *img = img->Affine(op.args);
+            break;
+            
+        case OP_FUN:
+            img->Fun();
+            break;
+            
+        case OP_SAMPLING:
+            img->SetSamplingMethod((int) op.args[0]);
+            break;
+            
+        default:
+            assert(!"not a chain operation");
+    }
+    
+    // -sampling holds for the rest of the chain, not just until the next operation that makes a new image
+    if (op.type == OP_CROP || op.type == OP_SCALE || op.type == OP_ROTATE || op.type == OP_AFFINE) {
+        img->SetSamplingMethod(sampling);
+    }
+}
+
+
+/**
+ * Geometric runs
+ **/
+
+/**
+ * A run of geometric operations, as the one affine map from the image the
+ * run started on to the canvas the last one leaves.  Quarter turns are kept
+ * out of runs: on their own they're exact copies (see RotateQuarters), where
+ * resampling them with the rest of a run would pick different pixels than
+ * running the steps one at a time.
+ **/
+struct GeometryRun
+{
+    Chain ops;
+    double m[6];
+    int width, height;
+    std::vector<AffineWindow> canvases;     // the canvases the operations before the last one left, mapped from the source
+    bool quarterTurn;                       // the run is a lone quarter turn
+    string run;
+    
+    GeometryRun () : quarterTurn(false) {}
+    
+    bool Empty () const { return ops.empty(); }
+    
+    // Adds op to the run, first running what's in it on img if op can't join it
+    void Add (Image *img, const Operation& op, ChainProfile *profile) {
+        bool quarter = op.type == OP_ROTATE && IsQuarterTurn(op.args[0], ops.empty() ? img->Width() : width,
+                                                                          ops.empty() ? img->Height() : height);
+        if (quarter || quarterTurn) {
+            Apply(img, profile);
+        }
+        quarterTurn = quarter;
+        
+        if (ops.empty()) {
+            double identity[6] = { 1, 0, 0, 0, 1, 0 };
+            copy(identity, identity + 6, m);
+            width = img->Width();
+            height = img->Height();
+        } else {
+            AffineWindow canvas;
+            copy(m, m + 6, canvas.m);
+            canvas.width = width;
+            canvas.height = height;
+            canvases.push_back(canvas);
+        }
+        
+        // the canvas each operation leaves is worked out the way the operation itself would, so the ones after it
+        // see the same size (and, for rotations, the same center)
+        double step[6] = { 1, 0, 0, 0, 1, 0 };
+        switch (op.type) {
+            case OP_CROP:
+                step[2] = -op.args[0];
+                step[5] = -op.args[1];
+                width = (int) op.args[2];
+                height = (int) op.args[3];
+                break;
+                
+            case OP_SCALE:
+                step[0] = op.args[0];
+                step[4] = op.args[1];
+                width = max((int) (width * op.args[0]), 1);
+                height = max((int) (height * op.args[1]), 1);
+                break;
+                
+            case OP_ROTATE:
+                CenteredRotation(width, height, op.args[0], step, &width, &height);
+                break;
+                
+            case OP_AFFINE:
+                copy(op.args, op.args + 6, step);
+                AffineBounds(step, width, height, &width, &height);
+                break;
+        }
+        ComposeAffine(m, step, m);
+        
+        ops.push_back(op);
+        run += run.empty() ? "" : "+";
+        run += OperationName(op.type);
+    }
+    
+    // Runs the whole run on img, moving the result into it, and starts a new run
+    void Apply (Image *img, ChainProfile *profile) {
+        if (ops.empty()) {
+            return;
+        }
+        
+        if (profile) profile->Begin(img);
+        
+        // a lone operation runs as it is; crops of crops are still a crop.  Anything else samples img just the once
+        bool shift = m[0] == 1 && m[1] == 0 && m[3] == 0 && m[4] == 1 && m[2] == floor(m[2]) && m[5] == floor(m[5]);
+        if (ops.size() == 1) {
+            RunOperation(img, ops[0]);
+        } else if (shift && m[2] <= 0 && m[5] <= 0 && width - m[2] <= img->Width() && height - m[5] <= img->Height()) {
+            RunOperation(img, Operation(OP_CROP, -m[2], -m[5], width, height));
+        } else {
+            // the canvases in between only matter where they cut some of the image off
+            double inverse[6];
+            InvertAffine(m, inverse);
+            vector<AffineWindow> windows;
+            
+            for (size_t i = 0; i < canvases.size(); i++) {
+                const AffineWindow& canvas = canvases[i];
+                int right, bottom;
+                AffineBounds(canvas.m, img->Width(), img->Height(), &right, &bottom);
+                
+                bool cuts = right > canvas.width || bottom > canvas.height;
+                for (int corner = 0; corner < 4; corner++) {
+                    double x = (corner & 1) ? img->Width() : 0, y = (corner & 2) ? img->Height() : 0;
+                    cuts = cuts || canvas.m[0] * x + canvas.m[1] * y + canvas.m[2] < -1e-6 || canvas.m[3] * x + canvas.m[4] * y + canvas.m[5] < -1e-6;
+                }
+                
+                if (cuts) {
+                    AffineWindow window = canvas;
+                    ComposeAffine(inverse, canvas.m, window.m);
+                    windows.push_back(window);
+                }
+            }
+            
+            int sampling = img->sampling_method;
+            *img = img->Affine(m, width, height, &windows);
+            img->SetSamplingMethod(sampling);
+        }
+        
+        if (profile) profile->End(run, img);
+        
+        ops.clear();
+        canvases.clear();
+        quarterTurn = false;
+        run.clear();
+    }
+};
+
+
+/**
+ * Float chains
+ **/
+struct FloatChain
+{
+    Image *img;
+    FloatImage *work;           // the float copy, once a float operation has been reached
+    bool imgCurrent;            // img has everything work has been through
+    ColorTransform pending;     // the run of point operations that hasn't been applied to work yet
+    string run;
+    ChainProfile *profile;
+    
+    // Applies the pending run to work
+    void Flush () {
+        if (run.empty()) {
+            return;
+        }
+        
+        if (profile) profile->Begin(img);
+        work->Apply(pending);
+        if (profile) profile->End(run, img);
+        
+        pending = ColorTransform();
+        run.clear();
+    }
+    
+    // Brings img up to date with work
+    void Store () {
+        Flush();
+        if (work == NULL || imgCurrent) {
+            return;
+        }
+        
+        if (profile) profile->Begin(img);
+        work->Store(*img);
+        if (profile) profile->End("toImage", img);
+        imgCurrent = true;
+    }
+    
+    void RunFloatOperation (const Operation& op) {
+        if (work == NULL) {
+            if (profile) profile->Begin(img);
+            work = new FloatImage(*img);
+            if (profile) profile->End("toFloat", img);
+        }
+        imgCurrent = false;
+        
+        switch (op.type) {
+            case OP_BRIGHTNESS:
+                pending = pending.Then(ColorTransform::Brighten(op.args[0]));
+                break;
+                
+            case OP_CONTRAST: {
+                // the mean has to come from the image as the operations before it leave it
+                Flush();
+                if (profile) profile->Begin(img);
+                float mean = work->MeanLuminance();
+                if (profile) profile->End("mean", img);
+                
+                pending = ColorTransform::ChangeContrast(op.args[0], mean);
+                break;
+            }
+                
+            case OP_SATURATION:
+                pending = pending.Then(ColorTransform::ChangeSaturation(op.args[0]));
+                break;
+                
+            case OP_EXTRACT_CHANNEL:
+                pending = pending.Then(ColorTransform::ExtractChannel((int) op.args[0]));
+                break;
+                
+            case OP_BLUR:
+            case OP_SHARPEN:
+                Flush();
+                if (profile) profile->Begin(img);
+                if (op.type == OP_BLUR) {
+                    work->Blur((int) op.args[0], op.args[1]);
+                } else {
+                    work->Sharpen((int) op.args[0]);
+                }
+                if (profile) profile->End(OperationName(op.type), img);
+                return;
+        }
+        
+        run += run.empty() ? "" : "+";
+        run += OperationName(op.type);
+    }
+};
+
+
+static void RunFloatChain (Image *img, const Chain& chain, ChainProfile *profile) {
+    FloatChain state;
+    state.img = img;
+    state.work = NULL;
+    state.imgCurrent = true;
+    state.profile = profile;
+    GeometryRun geometry;
+    
+    for (size_t i = 0; i < chain.size(); i++) {
+        const Operation& op = chain[i];
+        
+        if (IsGeometricOperation(op)) {
+            // warps work on the 8 bit image, and leave nothing of the float copy worth keeping
+            state.Store();
+            delete state.work;
+            state.work = NULL;
+            geometry.Add(state.img, op, profile);
+            continue;
+        }
+        geometry.Apply(state.img, profile);
+        
+        if (IsFloatOperation(op.type)) {
+            state.RunFloatOperation(op);
+            continue;
+        }
+        
+        // anything else needs the 8 bit image
+        state.Store();
+        
+        if (profile) profile->Begin(state.img);
+        RunOperation(state.img, op);
+        if (profile) profile->End(OperationName(op.type), state.img);
+        
+        // writing the image or its histogram out, or changing the sampling method, leaves the float copy as good as it was
+        if (op.type != OP_OUTPUT && op.type != OP_HISTOGRAM && op.type != OP_SAMPLING) {
+            delete state.work;
+            state.work = NULL;
+        }
+    }
+    
+    geometry.Apply(state.img, profile);
+    state.Store();
+    delete state.work;
+}
+
+
+void RunChain (Image *img, const Chain& chain, ChainProfile *profile, int format) {
+    if (format == CHAIN_FLOAT) {
+        RunFloatChain(img, chain, profile);
+        ScratchTrim();
+        return;
+    }
+    
+    // the run of point operations that hasn't been applied yet
+    PointPipeline pending;
+    string run;
+    
+    // and the run of geometric operations
+    GeometryRun geometry;
+    
+    for (size_t i = 0; i < chain.size(); i++) {
+        const Operation& op = chain[i];
+        
+        if (IsGeometricOperation(op)) {
+            FlushPointOperations(pending, run, img, profile);
+            geometry.Add(img, op, profile);
+            continue;
+        }
+        geometry.Apply(img, profile);
+        
+        if (IsPointOperation(op.type)) {
+            AddPointOperation(pending, run, img, op, profile);
+            continue;
+        }
+        
+        // anything else ends the run
+        FlushPointOperations(pending, run, img, profile);
+        
+        if (profile) profile->Begin(img);
+        RunOperation(img, op);
+        if (profile) profile->End(OperationName(op.type), img);
+    }
+    
+    geometry.Apply(img, profile);
+    FlushPointOperations(pending, run, img, profile);
+    
+    // the snapshot and spare buffer the chain kept on this thread go back to the pool, where its limit covers them
+    ScratchTrim();
+}
@@ -0,0 +1,92 @@
+//Chain.h
+//
+//The list of operations given on the command line
+//
+//  main.cpp turns the arguments into a Chain, which RunChain then applies to
+//  an image in order.  Runs of consecutive per-pixel operations are fused into
+//  a single pass over the image (see PointPipeline), and runs of consecutive
+//  crops, scales, rotations and affine warps into a single Affine from the
+//  image the run started with, so nothing in between is resampled twice.
+
+#ifndef CHAIN_INCLUDED
+#define CHAIN_INCLUDED
+
+#include <vector>
+#include "image.h"
+#include "profile.h"
+
+/**
+ * operations
+ **/
+enum {
+    OP_INPUT,
+    OP_OUTPUT,
+    OP_NOISE,
+    OP_BRIGHTNESS,
+    OP_CONTRAST,
+    OP_SATURATION,
+    OP_CROP,
+    OP_EXTRACT_CHANNEL,
+    OP_QUANTIZE,
+    OP_RANDOM_DITHER,
+    OP_BLUR,
+    OP_SHARPEN,
+    OP_EDGE_DETECT,
+    OP_ORDERED_DITHER,
+    OP_FLOYD_STEINBERG_DITHER,
+    OP_SCALE,
+    OP_ROTATE,
+    OP_FUN,
+    OP_SAMPLING,
+    OP_BOX_BLUR,
+    OP_FAST_BLUR,
+    OP_HISTOGRAM,
+    OP_EQUALIZE,
+    OP_AUTOLEVELS,
+    OP_AFFINE,
+    OP_N_OPERATIONS
+};
+
+struct Operation
+{
+    int type;
+    double args[6];
+    char *fname;    // for OP_INPUT, OP_OUTPUT and OP_HISTOGRAM
+
+    Operation (int type_, double a0=0, double a1=0, double a2=0, double a3=0, double a4=0, double a5=0) : type(type_), fname(NULL)
+    { args[0] = a0; args[1] = a1; args[2] = a2; args[3] = a3; args[4] = a4; args[5] = a5; }
+};
+
+typedef std::vector<Operation> Chain;
+
+/**
+ * Formats RunChain can keep the image in between operations
+ **/
+enum {
+    CHAIN_8BIT,     // Image, rounded to 8 bits after every operation
+    CHAIN_FLOAT     // FloatImage wherever an operation has a float version (see FloatImage.h)
+};
+
+// True for operations that only change each pixel based on that pixel
+bool IsPointOperation (int type);
+
+// True for crops, scales without a filter, rotations and affine warps, which RunChain puts together into one warp
+bool IsGeometricOperation (const Operation& op);
+
+// True for operations that have a FloatImage version
+bool IsFloatOperation (int type);
+
+// The command line option for the operation, without the '-'
+const char* OperationName (int type);
+
+/**
+ * Runs the chain on img (an empty Image if the chain starts with an
+ * OP_INPUT), leaving the result in it.  Operations that make a new image
+ * move it into img, which lets go of the pixels it had.  If profile isn't
+ * NULL, every pass over the image is added to it.  format is CHAIN_8BIT or
+ * CHAIN_FLOAT.  The calling thread's scratch memory is given back to the
+ * buffer pool at the end (see ScratchTrim).
+ **/
+void RunChain (Image *img, const Chain& chain, ChainProfile *profile = NULL, int format = CHAIN_8BIT);
+
+#endif
@@ -0,0 +1,356 @@
+//
+//  floatimage.cpp
+//  Assignment1
+//
+
+#include "floatimage.h"
+#include "image.h"
+#include "planar.h"
+#include "parallel.h"
+#include "bufferpool.h"
+#include <string.h>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// the weights Pixel::Luminance uses, without its rounding down
+static const float LuminanceWeights[3] = { 76 / 256.0f, 150 / 256.0f, 29 / 256.0f };
+
+
+/**
+ * ColorTransform
+ **/
+ColorTransform::ColorTransform () {
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 4; k++) {
+            matrix[c][k] = c == k ? 1.0f : 0.0f;
+        }
+    }
+    alpha[0] = 1.0f;
+    alpha[1] = 0.0f;
+}
+
+
+ColorTransform ColorTransform::Brighten (double factor) {
+    ColorTransform t;
+    for (int c = 0; c < 3; c++) {
+        t.matrix[c][c] = factor;
+    }
+    
+    // alpha ends up opaque, like Image::Brighten leaves it
+    t.alpha[0] = 0.0f;
+    t.alpha[1] = 255.0f;
+    return t;
+}
+
+
+ColorTransform ColorTransform::ChangeContrast (double factor, float meanLuminance) {
+    // (1 - factor) * mean + factor * color, and the gray pixel Image::ChangeContrast uses has an alpha of 1
+    ColorTransform t;
+    for (int c = 0; c < 3; c++) {
+        t.matrix[c][c] = factor;
+        t.matrix[c][3] = (1.0f - factor) * meanLuminance;
+    }
+    t.alpha[0] = factor;
+    t.alpha[1] = 1.0f - factor;
+    return t;
+}
+
+
+ColorTransform ColorTransform::ChangeSaturation (double factor) {
+    // (1 - factor) * luminance + factor * color, and again the gray pixel has an alpha of 1
+    ColorTransform t;
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++) {
+            t.matrix[c][k] = (1.0f - factor) * LuminanceWeights[k] + (c == k ? factor : 0.0f);
+        }
+    }
+    t.alpha[0] = factor;
+    t.alpha[1] = 1.0f - factor;
+    return t;
+}
+
+
+ColorTransform ColorTransform::ExtractChannel (int channel) {
+    ColorTransform t;
+    if (channel >= IMAGE_CHANNEL_RED && channel <= IMAGE_CHANNEL_BLUE) {
+        for (int c = 0; c < 3; c++) {
+            t.matrix[c][c] = c == channel ? 1.0f : 0.0f;
+        }
+    }
+    return t;
+}
+
+
+ColorTransform ColorTransform::Then (const ColorTransform& next) const {
+    ColorTransform t;
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 4; k++) {
+            float total = k == 3 ? next.matrix[c][3] : 0.0f;
+            for (int l = 0; l < 3; l++) {
+                total += next.matrix[c][l] * matrix[l][k];
+            }
+            t.matrix[c][k] = total;
+        }
+    }
+    t.alpha[0] = next.alpha[0] * alpha[0];
+    t.alpha[1] = next.alpha[0] * alpha[1] + next.alpha[1];
+    return t;
+}
+
+
+/**
+ * Row kernels
+ **/
+
+// Applies the transform to count pixels of the r, g, b and a rows, in place
+static void TransformSpan (const ColorTransform& t, float *r, float *g, float *b, float *a, int count) {
+    int i = 0;
+    
+#if defined(__AVX2__)
+    __m256 m[3][4];
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 4; k++) {
+            m[c][k] = _mm256_set1_ps(t.matrix[c][k]);
+        }
+    }
+    __m256 alphaScale = _mm256_set1_ps(t.alpha[0]), alphaOffset = _mm256_set1_ps(t.alpha[1]);
+    
+    for (; i + 8 <= count; i += 8) {
+        __m256 vr = _mm256_loadu_ps(r + i), vg = _mm256_loadu_ps(g + i), vb = _mm256_loadu_ps(b + i);
+        __m256 out[3];
+        for (int c = 0; c < 3; c++) {
+            out[c] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[c][0], vr), _mm256_mul_ps(m[c][1], vg)),
+                                   _mm256_add_ps(_mm256_mul_ps(m[c][2], vb), m[c][3]));
+        }
+        _mm256_storeu_ps(r + i, out[0]);
+        _mm256_storeu_ps(g + i, out[1]);
+        _mm256_storeu_ps(b + i, out[2]);
+        _mm256_storeu_ps(a + i, _mm256_add_ps(_mm256_mul_ps(alphaScale, _mm256_loadu_ps(a + i)), alphaOffset));
+    }
+#elif defined(__SSE2__)
+    __m128 m[3][4];
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 4; k++) {
+            m[c][k] = _mm_set1_ps(t.matrix[c][k]);
+        }
+    }
+    __m128 alphaScale = _mm_set1_ps(t.alpha[0]), alphaOffset = _mm_set1_ps(t.alpha[1]);
+    
+    for (; i + 4 <= count; i += 4) {
+        __m128 vr = _mm_loadu_ps(r + i), vg = _mm_loadu_ps(g + i), vb = _mm_loadu_ps(b + i);
+        __m128 out[3];
+        for (int c = 0; c < 3; c++) {
+            out[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[c][0], vr), _mm_mul_ps(m[c][1], vg)),
+                                _mm_add_ps(_mm_mul_ps(m[c][2], vb), m[c][3]));
+        }
+        _mm_storeu_ps(r + i, out[0]);
+        _mm_storeu_ps(g + i, out[1]);
+        _mm_storeu_ps(b + i, out[2]);
+        _mm_storeu_ps(a + i, _mm_add_ps(_mm_mul_ps(alphaScale, _mm_loadu_ps(a + i)), alphaOffset));
+    }
+#endif
+    
+    for (; i < count; i++) {
+        float in[3] = { r[i], g[i], b[i] };
+        float *out[3] = { r, g, b };
+        for (int c = 0; c < 3; c++) {
+            out[c][i] = (t.matrix[c][0] * in[0] + t.matrix[c][1] * in[1]) + (t.matrix[c][2] * in[2] + t.matrix[c][3]);
+        }
+        a[i] = t.alpha[0] * a[i] + t.alpha[1];
+    }
+}
+
+
+/**
+ * FloatImage
+ **/
+void FloatImage::Allocate (int width_, int height_) {
+    assert(width_ > 0 && height_ > 0);
+    
+    width = width_;
+    height = height_;
+    
+    // rows start on a 32 byte boundary
+    stride = (width + 7) / 8 * 8;
+    planeSize = (size_t) stride * height;
+    
+    planes = (float*) PoolAllocate(planeSize * IMAGE_N_CHANNELS * sizeof(float));
+}
+
+
+FloatImage::FloatImage (int width_, int height_) {
+    Allocate(width_, height_);
+    memset(planes, 0, planeSize * IMAGE_N_CHANNELS * sizeof(float));
+}
+
+
+FloatImage::FloatImage (const Image& img) {
+    Allocate(img.Width(), img.Height());
+    
+    ParallelFor(0, height, [&](int y0, int y1) {
+        vector<Component> components(width * IMAGE_N_CHANNELS);
+        Component *channels[IMAGE_N_CHANNELS];
+        for (int c = 0; c < IMAGE_N_CHANNELS; c++) {
+            channels[c] = &components[c * width];
+        }
+        
+        for (int y = y0; y < y1; y++) {
+            DeinterleaveSpan(img.Row(y), channels[0], channels[1], channels[2], channels[3], width);
+            for (int c = 0; c < IMAGE_N_CHANNELS; c++) {
+                FloatSpan(channels[c], Row(c, y), width);
+            }
+        }
+    });
+}
+
+
+FloatImage::FloatImage (const FloatImage& src) {
+    Allocate(src.width, src.height);
+    memcpy(planes, src.planes, planeSize * IMAGE_N_CHANNELS * sizeof(float));
+}
+
+
+FloatImage::~FloatImage () {
+    PoolRelease(planes, planeSize * IMAGE_N_CHANNELS * sizeof(float));
+}
+
+
+void FloatImage::Store (Image& img) const {
+    assert(img.Width() == width && img.Height() == height);
+    img.Unshare();
+    
+    ParallelFor(0, height, [&](int y0, int y1) {
+        vector<Component> components(width * IMAGE_N_CHANNELS);
+        Component *channels[IMAGE_N_CHANNELS];
+        for (int c = 0; c < IMAGE_N_CHANNELS; c++) {
+            channels[c] = &components[c * width];
+        }
+        
+        for (int y = y0; y < y1; y++) {
+            for (int c = 0; c < IMAGE_N_CHANNELS; c++) {
+                RoundSpan(Row(c, y), channels[c], width);
+            }
+            InterleaveSpan(channels[0], channels[1], channels[2], channels[3], img.Row(y), width);
+        }
+    });
+    img.MarkDirty();
+}
+
+
+void FloatImage::Swap (FloatImage& other) {
+    assert(other.width == width && other.height == height);
+    swap(planes, other.planes);
+}
+
+
+float FloatImage::MeanLuminance () const {
+    // totaled per row so the sum doesn't depend on how the rows get split between threads
+    vector<double> rowTotals(height);
+    
+    ParallelFor(0, height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            const float *r = Row(IMAGE_CHANNEL_RED, y), *g = Row(IMAGE_CHANNEL_GREEN, y), *b = Row(IMAGE_CHANNEL_BLUE, y);
+            double rowTotal = 0.0;
+            
+            for (int x = 0; x < width; x++) {
+                rowTotal += LuminanceWeights[0] * r[x] + LuminanceWeights[1] * g[x] + LuminanceWeights[2] * b[x];
+            }
+            rowTotals[y] = rowTotal;
+        }
+    });
+    
+    double total = 0.0;
+    for (int y = 0; y < height; y++) {
+        total += rowTotals[y];
+    }
+    
+    return total / ((double) width * height);
+}
+
+
+void FloatImage::Apply (const ColorTransform& transform) {
+    ParallelFor(0, height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            TransformSpan(transform, Row(0, y), Row(1, y), Row(2, y), Row(3, y), width);
+        }
+    });
+}
+
+
+void FloatImage::Blur (int n, double sigma) {
+    // the same kernel Image::Blur uses
+    int radius = n / 2;
+    
+    if (radius <= 0) {
+        return;
+    }
+    
+    if (sigma <= 0.0) {
+        sigma = max(1.0, radius / 3.0);
+    }
+    
+    int taps = 2 * radius + 1;
+    vector<float> kernel(taps);
+    GaussianKernel(radius, sigma, &kernel[0]);
+    
+    FloatImage blurred;
+    blurred.Allocate(width, height);
+    
+    ParallelFor(0, height, [&](int y0, int y1) {
+        // one channel of one row of the vertical pass, padded with radius values on each side
+        vector<float> column(width + 2 * radius);
+        float *center = &column[radius];
+        
+        for (int j = y0; j < y1; j++) {
+            for (int c = 0; c < 3; c++) {
+                
+                // vertical pass, extending the top/bottom rows past the edges
+                fill(column.begin(), column.end(), 0.0f);
+                for (int k = -radius; k <= radius; k++) {
+                    MultiplyAddSpan(center, Row(c, min(max(j + k, 0), height - 1)), kernel[k + radius], width);
+                }
+                
+                // extend the leftmost/rightmost values into the padding
+                for (int i = 1; i <= radius; i++) {
+                    center[-i] = center[0];
+                    center[width - 1 + i] = center[width - 1];
+                }
+                
+                // horizontal pass, straight into the blurred image
+                float *dst = blurred.Row(c, j);
+                fill(dst, dst + width, 0.0f);
+                for (int k = 0; k < taps; k++) {
+                    MultiplyAddSpan(dst, &column[k], kernel[k], width);
+                }
+            }
+            
+            // alpha is left alone
+            memcpy(blurred.Row(IMAGE_CHANNEL_ALPHA, j), Row(IMAGE_CHANNEL_ALPHA, j), width * sizeof(float));
+        }
+    });
+    
+    Swap(blurred);
+}
+
+
+void FloatImage::Sharpen (int n) {
+    FloatImage blurred(*this);
+    blurred.Blur(n);
+    
+    // extrapolate away from the blurred version: 2 * color - blurred (alpha is the same in both, so it stays put)
+    ParallelFor(0, height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            for (int c = 0; c < 3; c++) {
+                MultiplyAddSpan(Row(c, y), Row(c, y), 1.0f, width);
+                MultiplyAddSpan(Row(c, y), blurred.Row(c, y), -1.0f, width);
+            }
+        }
+    });
+}
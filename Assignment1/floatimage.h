@@ -0,0 +1,90 @@
+//FloatImage.h
+//
+//Float working copy of an image, for chains that shouldn't round to 8 bits between steps
+//
+//  Every Image method rounds and clamps its result back into 8 bit
+//  components, so a chain of filters loses a little more precision (and
+//  clips a little more) at every step.  With -float, the chain converts the
+//  image to a FloatImage the first time it reaches an operation that has a
+//  float version, and stays in float until an operation that doesn't (or
+//  the output) needs the 8 bit image back.  Components are kept in the same
+//  0..255 scale as Image, but are never rounded or clamped in between.
+
+#ifndef FLOATIMAGE_INCLUDED
+#define FLOATIMAGE_INCLUDED
+
+#include <stddef.h>
+#include "pixel.h"
+
+class Image;
+
+/**
+ * ColorTransform - a per-pixel operation that's affine in the color:
+ * (r, g, b) becomes matrix * (r, g, b, 1), and alpha becomes
+ * alpha[0] * a + alpha[1].  Every point operation with a float version is
+ * one of these, so a run of them composes into one.
+ **/
+struct ColorTransform
+{
+    float matrix[3][4];
+    float alpha[2];
+
+    // The identity
+    ColorTransform ();
+
+    // The same operations as the Image methods, without the rounding and clamping
+    static ColorTransform Brighten (double factor);
+    static ColorTransform ChangeContrast (double factor, float meanLuminance);
+    static ColorTransform ChangeSaturation (double factor);
+    static ColorTransform ExtractChannel (int channel);
+
+    // This transform followed by next
+    ColorTransform Then (const ColorTransform& next) const;
+};
+
+class FloatImage
+{
+public:
+    // Blank image
+    FloatImage (int width, int height);
+
+    // Converts an Image, on the thread pool
+    FloatImage (const Image& img);
+
+    FloatImage (const FloatImage& src);
+    ~FloatImage ();
+
+    int Width  () const { return width; }
+    int Height () const { return height; }
+
+    // Row y of a channel (IMAGE_CHANNEL_RED to IMAGE_CHANNEL_ALPHA)
+    float* Row (int channel, int y) const { return planes + channel * planeSize + (size_t) y * stride; }
+
+    // Rounds and clamps back into img, which has to be the same size
+    void Store (Image& img) const;
+
+    // Exchanges the pixels of two images of the same size
+    void Swap (FloatImage& other);
+
+    // Same as the Image methods, without the rounding and clamping
+    float MeanLuminance () const;
+    void Apply (const ColorTransform& transform);
+    void Blur (int n, double sigma = 0.0);
+    void Sharpen (int n);
+
+private:
+    void operator= (const FloatImage&);
+
+    // No planes yet, for Allocate
+    FloatImage () : planes(NULL) {}
+
+    // Allocates the planes for a width x height image, leaving them uninitialized
+    void Allocate (int width, int height);
+
+    float *planes;
+    size_t planeSize;   // floats from one plane to the next
+    int width, height;
+    int stride;         // floats from one row to the next
+};
+
+#endif
@@ -7,16 +7,106 @@
 //
 
 #include "image.h"
+#include "parallel.h"
+#include "stream.h"
+#include "bufferpool.h"
+#include "planar.h"
+#include "integral.h"
+#include "imagestats.h"
+#include "tiled.h"
+#include "resample.h"
+#include "mip.h"
+#include "rotate.h"
+#include "warp.h"
+#include "scratch.h"
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <atomic>
 using namespace std;
 
+// pixel bytes and buffers allocated by every Image so far, for profiling
+static atomic<long long> bytesAllocated(0);
+static atomic<long long> buffersAllocated(0);
+
+long long ImageBytesAllocated () {
+    return bytesAllocated;
+}
+
+long long ImageBuffersAllocated () {
+    return buffersAllocated;
+}
+
+/**
+ * Pixel buffers
+ **/
+
+// Gives back pixels stbi_load allocated
+static void FreeLoadedPixels (void *raw, size_t) {
+    stbi_image_free(raw);
+}
+
+
+// Wraps bytes of raw, which release gives back, in a buffer with just the one reference
+static PixelBuffer* WrapBuffer (void *raw, size_t bytes, void (*release) (void*, size_t)) {
+    assert(raw != NULL);
+    
+    PixelBuffer *buffer = new PixelBuffer;
+    buffer->references = 1;
+    buffer->raw = (uint8_t*) raw;
+    buffer->bytes = bytes;
+    buffer->release = release;
+    bytesAllocated += bytes;
+    buffersAllocated++;
+    return buffer;
+}
+
+
+// A buffer of bytes (the thread's spare one if it fits, see Scratch.h), which goes back to be the spare again
+static PixelBuffer* NewBuffer (size_t bytes) {
+    return WrapBuffer(TakeSparePixels(bytes), bytes, KeepSparePixels);
+}
+
+
+// Lets go of a reference to buffer, and frees it if that was the last one
+static void ReleaseBuffer (PixelBuffer *buffer) {
+    if (buffer == NULL || --buffer->references > 0) {
+        return;
+    }
+    
+    buffer->release(buffer->raw, buffer->bytes);
+    delete buffer;
+}
+
+
+// Copies the rows of src into the packed rows of dst, which is the same size
+static void CopyRows (const Image& src, Pixel *dst) {
+    for (int y = 0; y < src.Height(); y++) {
+        memcpy(dst + (size_t) y * src.Width(), src.Row(y), src.Width() * sizeof(Pixel));
+    }
+}
+
+
 /**
  * Image
  **/
+Image::Image (){
+    
+    width           = 0;
+    height          = 0;
+    num_pixels      = 0;
+    stride          = 0;
+    sampling_method = IMAGE_SAMPLING_POINT;
+    stats           = NULL;
+    pyramid         = NULL;
+    buffer          = NULL;
+    data.raw        = NULL;
+}
+
 Image::Image (int width_, int height_){
     
     assert(width_ > 0);
@@ -25,19 +115,16 @@ Image::Image (int width_, int height_){
     width           = width_;
     height          = height_;
     num_pixels      = width * height;
+    stride          = width;
     sampling_method = IMAGE_SAMPLING_POINT;
+    stats           = NULL;
+    pyramid         = NULL;
     
-    data.raw = new uint8_t[num_pixels*4];
-    int b = 0; //which byte to write to
-    for (int j = 0; j < height; j++){
-        for (int i = 0; i < width; i++){
-            data.raw[b++] = 0;
-            data.raw[b++] = 0;
-            data.raw[b++] = 0;
-            data.raw[b++] = 0;
-        }
-    }
-    assert(data.raw != NULL);
+    buffer = NewBuffer(num_pixels*4);
+    data.raw = buffer->raw;
+    
+    // a reused buffer still has the last image in it
+    memset(data.raw, 0, num_pixels*4);
 }
 
 Image::Image (const Image& src){
@@ -45,48 +132,229 @@ Image::Image (const Image& src){
     width           = src.width;
     height          = src.height;
     num_pixels      = width * height;
+    stride          = src.stride;
     sampling_method = IMAGE_SAMPLING_POINT;
+    stats           = NULL;
+    pyramid         = NULL;
     
-    data.raw = new uint8_t[num_pixels*4];
-    
-    memcpy(data.raw, src.data.raw, num_pixels * 4);
+    // nothing is copied until one of the two changes its pixels (see Unshare).  An empty image has no buffer
+    buffer = src.buffer;
+    if (buffer != NULL) {
+        buffer->references++;
+    }
+    data.pixels = src.data.pixels;
     //*data.raw = *src.data.raw;
 }
 
+Image::Image (const Image& src, int x, int y, int w, int h){
+    
+    assert(w > 0 && h > 0);
+    assert(x >= 0 && y >= 0 && x + w <= src.width && y + h <= src.height);
+    
+    width           = w;
+    height          = h;
+    num_pixels      = width * height;
+    stride          = src.stride;
+    sampling_method = IMAGE_SAMPLING_POINT;
+    stats           = NULL;
+    pyramid         = NULL;
+    
+    buffer = src.buffer;
+    buffer->references++;
+    data.pixels = src.data.pixels + (size_t) y * stride + x;
+}
+
 Image::Image (char* fname){
     
-    int numComponents; //(e.g., Y, YA, RGB, or RGBA)
-    data.raw = stbi_load(fname, &width, &height, &numComponents, 4);
+    width           = 0;
+    height          = 0;
+    num_pixels      = 0;
+    stride          = 0;
+    sampling_method = IMAGE_SAMPLING_POINT;
+    stats           = NULL;
+    pyramid         = NULL;
+    buffer          = NULL;
+    data.raw        = NULL;
     
-    if (data.raw == NULL){
+    if (!Load(fname)){
         printf("Error loading image: %s", fname);
         exit(-1);
     }
+}
+
+bool Image::Load (char* fname){
     
+    int w, h;
+    int numComponents; //(e.g., Y, YA, RGB, or RGBA)
+    uint8_t *raw = stbi_load(fname, &w, &h, &numComponents, 4);
+    
+    if (raw == NULL){
+        return false;
+    }
     
+    ReleaseBuffer(buffer);
+    delete stats;
+    delete pyramid;
+    stats = NULL;
+    pyramid = NULL;
+    
+    // stb_image allocated it, so it has to give it back too
+    width = w;
+    height = h;
     num_pixels = width * height;
-    sampling_method = IMAGE_SAMPLING_POINT;
+    buffer = WrapBuffer(raw, num_pixels*4, FreeLoadedPixels);
+    data.raw = raw;
+    stride = width;
+    return true;
+}
+
+Image::Image (Image&& src){
+    
+    buffer = NULL;
+    stats = NULL;
+    pyramid = NULL;
+    *this = std::move(src);
+}
+
+Image& Image::operator= (const Image& src){
+    
+    if (this != &src) {
+        *this = Image(src);
+    }
+    return *this;
+}
+
+Image& Image::operator= (Image&& src){
+    
+    if (this == &src) {
+        return *this;
+    }
+    
+    ReleaseBuffer(buffer);
+    delete stats;
+    delete pyramid;
+    
+    width           = src.width;
+    height          = src.height;
+    num_pixels      = src.num_pixels;
+    stride          = src.stride;
+    sampling_method = src.sampling_method;
+    buffer          = src.buffer;
+    data            = src.data;
+    stats           = src.stats;
+    
+    // the pyramid is built from the Image object itself, not just its pixels, so it stays behind
+    pyramid = NULL;
+    delete src.pyramid;
+    
+    src.width = src.height = src.num_pixels = src.stride = 0;
+    src.buffer = NULL;
+    src.data.raw = NULL;
+    src.stats = NULL;
+    src.pyramid = NULL;
+    return *this;
 }
 
 Image::~Image (){
-    delete data.raw;
+    ReleaseBuffer(buffer);
     data.raw = NULL;
+    delete stats;
+    delete pyramid;
 }
 
-void Image::Write(char* fname){
+
+void Image::Unshare (bool keep) {
+    if (buffer == NULL || buffer->references == 1) {
+        return;
+    }
+    
+    // the other images keep the old buffer, and this one gets a packed copy of its own window of it
+    PixelBuffer *own = NewBuffer(num_pixels*4);
+    if (keep) {
+        CopyRows(*this, (Pixel*) own->raw);
+    }
+    
+    ReleaseBuffer(buffer);
+    buffer = own;
+    data.raw = own->raw;
+    stride = width;
+}
+
+
+void Image::SwapPixels (Image& other) {
+    assert(other.width == width && other.height == height);
+    std::swap(buffer, other.buffer);
+    std::swap(data, other.data);
+    std::swap(stride, other.stride);
+}
+
+
+const ImageStats& Image::Stats () const {
+    if (stats == NULL) {
+        stats = new ImageStats;
+        stats->Compute(*this);
+    }
+    return *stats;
+}
+
+
+const Image& Image::MipLevel (int level) const {
+    if (level == 0) {
+        return *this;
+    }
+    if (pyramid == NULL) {
+        pyramid = new MipPyramid(*this);
+    }
+    return pyramid->Level(level);
+}
+
+
+int Image::MipLevels () const {
+    return pyramid ? pyramid->Levels() : MipPyramid(*this).Levels();
+}
+
+
+void Image::MarkDirty () {
+    delete stats;
+    stats = NULL;
+    delete pyramid;
+    pyramid = NULL;
+}
+
+void Image::Write(char* fname) const{
     
     int lastc = strlen(fname);
     
+    // only png takes a stride, so the others get a packed copy of a view
+    bool png = fname[lastc-1] == 'g' && fname[lastc-2] != 'p' && fname[lastc-2] != 'e';
+    bool ppm = fname[lastc-1] == 'm' && (fname[lastc-2] == 'p' || fname[lastc-2] == 'a');
+    if (stride != width && !png && !ppm) {
+        Image packed(*this);
+        packed.Unshare();
+        packed.Write(fname);
+        return;
+    }
+    
     switch (fname[lastc-1]){
         case 'g': //jpeg (or jpg) or png
             if (fname[lastc-2] == 'p' || fname[lastc-2] == 'e') //jpeg or jpg
                 stbi_write_jpg(fname, width, height, 4, data.raw, 95);  //95% jpeg quality
             else //png
-                stbi_write_png(fname, width, height, 4, data.raw, width*4);
+                stbi_write_png(fname, width, height, 4, data.raw, stride*4);
             break;
         case 'a': //tga (targa)
             stbi_write_tga(fname, width, height, 4, data.raw);
             break;
+        case 'm': //ppm or pam
+            if (fname[lastc-2] == 'p' || fname[lastc-2] == 'a') {
+                RowWriter writer(fname, width, height);
+                for (int y = 0; y < height; y++) {
+                    writer.WriteRows(Row(y), 1);
+                }
+                break;
+            }
+            stbi_write_bmp(fname, width, height, 4, data.raw);
+            break;
         case 'p': //bmp
         default:
             stbi_write_bmp(fname, width, height, 4, data.raw);
@@ -102,114 +370,220 @@ void Image::AddNoise (double factor) {
         return;
     }
     
+    Unshare();
+    
     // want to modify half of the total pixels in the image
     for(int i = 0; i < num_pixels * (factor / 2); i++) {
         // randomly select the pixels to modify
-        data.pixels[rand() % num_pixels] = PixelRandom();
+        int k = rand() % num_pixels;
+        Row(k / width)[k % width] = PixelRandom();
     }
+    
+    MarkDirty();
 }
 
 
 void Image::Brighten (double factor) {
-    int x,y;
-    for (x = 0 ; x < Width() ; x++)
-    {
-        for (y = 0 ; y < Height() ; y++)
-        {
-            Pixel p = GetPixel(x, y);
-            Pixel scaled_p;
-            scaled_p.r = ComponentClamp(factor*p.r);
-            scaled_p.g = ComponentClamp(factor*p.g);
-            scaled_p.b = ComponentClamp(factor*p.b);
-            GetPixel(x,y) = scaled_p;
+    Unshare();
+    
+    ParallelFor(0, height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            Pixel *row = Row(y);
+            ScaleSpan(row, row, width, factor);
+            
+            // only the color gets brightened - alpha ends up opaque
+            for (int x = 0; x < width; x++) {
+                row[x].a = 255;
+            }
         }
-    }
+    });
+    
+    MarkDirty();
 }
 
 
-void Image::ChangeContrast (double factor) {
-    // calculate mean luminance
-    float total = 0;
+float Image::MeanLuminance () {
+    return Stats().meanLuminance;
+}
 
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            total += GetPixel(i, j).Luminance();
-        }
-    }
+
+void Image::ChangeContrast (double factor) {
+    Unshare();
     
-    // get final mean luminance and store it as a pixel
-    float averageLuminance = total / num_pixels;
+    // get the mean luminance and store it as a pixel
+    float averageLuminance = MeanLuminance();
     Pixel luminancePixel = Pixel(averageLuminance, averageLuminance, averageLuminance, 1);
     
     // change each pixel
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            GetPixel(i, j) = PixelLerp(luminancePixel, GetPixel(i, j), factor);
+    ParallelFor(0, height, [&](int y0, int y1) {
+        // a row of the constant gray to interpolate against
+        vector<Pixel> gray(width, luminancePixel);
+        
+        for (int y = y0; y < y1; y++) {
+            Pixel *row = Row(y);
+            LerpSpan(&gray[0], row, row, width, factor);
         }
-    }
+    });
+    
+    MarkDirty();
 }
 
 
-void Image::ChangeSaturation(double factor) {
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            // calculate the luminance for the current pixel
-            float luminance = GetPixel(i, j).Luminance();
-            Pixel luminancePixel = Pixel(luminance, luminance, luminance, 1);
+// Runs the red, green and blue of every pixel through their tables, leaving alpha alone
+static void ApplyColorTables (Image *img, const Component table[3][256]) {
+    img->Unshare();
+    
+    ParallelFor(0, img->Height(), [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            Pixel *row = img->Row(y);
             
-            GetPixel(i, j) = PixelLerp(luminancePixel, GetPixel(i, j), factor);
+            for (int x = 0; x < img->Width(); x++) {
+                row[x].r = table[0][row[x].r];
+                row[x].g = table[1][row[x].g];
+                row[x].b = table[2][row[x].b];
+            }
         }
+    });
+}
+
+
+void Image::Equalize () {
+    const ImageStats& stats = Stats();
+    
+    // the luminance histogram's cumulative count, scaled so the darkest pixels go to 0 and the brightest to 255
+    long long first = 0;
+    for (int v = 0; v < 256 && first == 0; v++) {
+        first = stats.luminance[v];
+    }
+    if (first == num_pixels) {
+        // a single level has nowhere to be spread out to
+        return;
     }
+    
+    Component table[3][256];
+    long long below = 0;
+    for (int v = 0; v < 256; v++) {
+        below += stats.luminance[v];
+        table[0][v] = table[1][v] = table[2][v] = ComponentClamp((double) (below - first) * 255 / (num_pixels - first) + 0.5);
+    }
+    
+    // the same curve for every channel keeps the hues from shifting
+    ApplyColorTables(this, table);
+    MarkDirty();
 }
 
 
-Image* Image::Crop(int x, int y, int w, int h)
-{
-    // the final cropped version of the original image
-    Image *croppedImage = new Image(w, h);
+void Image::AutoLevels (double clip) {
+    const ImageStats& stats = Stats();
+    long long ignored = (long long) (clip * num_pixels);
     
-    for(int j = y; j < y + h; j++) {
-        for(int i = x; i < x + w; i++) {
-            // starting at the (i, j) in the original image and at the origin in the cropped image - getting/setting locations relative to those points
-            croppedImage->SetPixel(i - x, j - y, GetPixel(i, j));
+    Component table[3][256];
+    for (int c = 0; c < 3; c++) {
+        // the lowest and highest values with more than clip of the pixels beyond them
+        int low = 0;
+        long long below = stats.histogram[c][0];
+        while (low < 255 && below <= ignored) {
+            below += stats.histogram[c][++low];
+        }
+        
+        int high = 255;
+        long long above = stats.histogram[c][255];
+        while (high > 0 && above <= ignored) {
+            above += stats.histogram[c][--high];
+        }
+        
+        for (int v = 0; v < 256; v++) {
+            table[c][v] = high > low ? ComponentClamp((double) (v - low) * 255 / (high - low) + 0.5) : v;
         }
     }
-    return croppedImage;
+    
+    ApplyColorTables(this, table);
+    MarkDirty();
+}
+
+
+void Image::ChangeSaturation(double factor) {
+    Unshare();
+    
+    ParallelFor(0, height, [&](int y0, int y1) {
+        vector<Pixel> gray(width);
+        
+        for (int y = y0; y < y1; y++) {
+            Pixel *row = Row(y);
+            
+            // the gray level version of the row
+            for (int x = 0; x < width; x++) {
+                Component luminance = row[x].Luminance();
+                gray[x] = Pixel(luminance, luminance, luminance, 1);
+            }
+            
+            LerpSpan(&gray[0], row, row, width, factor);
+        }
+    });
+    
+    MarkDirty();
+}
+
+
+Image Image::Crop(int x, int y, int w, int h)
+{
+    // the final cropped version of the original image, looking into the same pixels
+    return Image(*this, x, y, w, h);
 }
 
 
 void Image::ExtractChannel(int channel) {
+    Unshare();
+    
     // go through all pixels
-    for(int i = 0; i < num_pixels; i++) {
-        // set the channels not the one passed in to 0
-        switch (channel) {
-            case IMAGE_CHANNEL_RED:
-                data.pixels[i].g = 0;
-                data.pixels[i].b = 0;
-                break;
-            case IMAGE_CHANNEL_GREEN:
-                data.pixels[i].r = 0;
-                data.pixels[i].b = 0;
-                break;
-            case IMAGE_CHANNEL_BLUE:
-                data.pixels[i].r = 0;
-                data.pixels[i].g = 0;
-                break;
+    ParallelFor(0, height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            Pixel *row = Row(y);
+            
+            for (int x = 0; x < width; x++) {
+                // set the channels not the one passed in to 0
+                switch (channel) {
+                    case IMAGE_CHANNEL_RED:
+                        row[x].g = 0;
+                        row[x].b = 0;
+                        break;
+                    case IMAGE_CHANNEL_GREEN:
+                        row[x].r = 0;
+                        row[x].b = 0;
+                        break;
+                    case IMAGE_CHANNEL_BLUE:
+                        row[x].r = 0;
+                        row[x].g = 0;
+                        break;
+                }
+            }
         }
-    }
+    });
+    
+    MarkDirty();
 }
 
 
 void Image::Quantize (int nbits) {
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            GetPixel(i, j) = PixelQuant(GetPixel(i, j), nbits);
+    Unshare();
+    
+    ParallelFor(0, height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            Pixel *row = Row(y);
+            
+            for (int x = 0; x < width; x++) {
+                row[x] = PixelQuant(row[x], nbits);
+            }
         }
-    }
+    });
+    
+    MarkDirty();
 }
 
 // TODO: put image results on website
 void Image::RandomDither (int nbits) {
+    Unshare();
+    
     srand(time(NULL));
     
     // the area that the random value can fall into
@@ -229,6 +603,7 @@ void Image::RandomDither (int nbits) {
         }
     }
     
+    MarkDirty();
 }
 
 
@@ -253,6 +628,8 @@ GAMMA = 5.0 / 16.0,
 DELTA = 1.0 / 16.0;
 
 void Image::FloydSteinbergDither(int nbits){
+    Unshare();
+    
     for (int i = 0; i < width; i++) {
         for (int j = 0; j < height; j++) {
             // must save original pixel since the error is determined from that
@@ -292,285 +669,333 @@ void Image::FloydSteinbergDither(int nbits){
             }
         }
     }
+    
+    MarkDirty();
 }
 
 
-void Image::Blur(int n) {
-
-    float filter[n][n];
-    
-    
-    // set up the Gaussian filter
-    
-    // use an intermediary array to store the possible Gaussian values
-    float intermediary[n / 2 + 1];
+// Fills kernel[0..2*radius] with a normalized 1D Gaussian centered at kernel[radius]
+void GaussianKernel(int radius, double sigma, float *kernel) {
+    double total = 0.0;
     
-    // calculate all possible Gaussian values to later be put into the filter
-    for (int i = 0; i <= n / 2; i++) {
-        intermediary[i] = (1.0 / sqrt(2.0 * M_PI)) * pow(M_E, -1.0 * pow(i, 2.0) / 2.0);
-        cout << "intermediary at " << i << " is " << intermediary[i] << endl;
+    for (int i = -radius; i <= radius; i++) {
+        kernel[i + radius] = exp(-1.0 * i * i / (2.0 * sigma * sigma));
+        total += kernel[i + radius];
     }
     
-    // center position in the filter
-    int center = n / 2;
-    
-    // needed for normalization
-    float total = 0.0;
-    
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            cout << "intermediary value being retrieved for i = " << i << " and j = " << j << " is " << max(abs(center - i), abs(center - j)) << endl;
-            filter[i][j] = intermediary[max(abs(center - i), abs(center - j))];
-            total += filter[i][j];
-        }
+    // normalize so the blur doesn't change the overall brightness
+    for (int i = 0; i < 2 * radius + 1; i++) {
+        kernel[i] /= total;
     }
+}
+
+
+void Image::Blur(int n, double sigma) {
+    // the filter extends radius pixels on each side of the center
+    int radius = n / 2;
     
-    // normalize
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            filter[i][j] /= total;
-            cout << "filter at x= " << i << " and y= " << j << " is " << filter[i][j] << endl;
-        }
+    if (radius <= 0) {
+        return;
     }
     
+    // wide enough that the kernel falls off to almost nothing at its ends
+    if (sigma <= 0.0) {
+        sigma = max(1.0, radius / 3.0);
+    }
     
-    // when doing the convolution math, we always need to pull from the original image, not the partially blurred version of the original image
-    Image *originalImage = new Image(*this);
+    int taps = 2 * radius + 1;
+    float *kernel = Scratch<float>(SCRATCH_TABLE, taps);
+    GaussianKernel(radius, sigma, kernel);
+    
+    // when doing the convolution math, we always need to pull from the original image, not the partially blurred version of the original image.
+    // the copy is planar and padded by radius pixels on each side, so both passes run straight down one channel's row with no edge checks.
+    // It lives in the thread's scratch memory, so a blur the same size as the last one doesn't allocate it again
+    PlanarImage originalImage(width, height, radius, SCRATCH_SNAPSHOT);
+    originalImage.Load(*this);
+    
+    // every pixel is written from the copy, so pixels shared with another image aren't copied first, just left to it
+    Unshare(false);
+    
+    ParallelFor(0, height, [&](int y0, int y1) {
+        // one channel of one row of the vertical pass, including the padding on each side, then the horizontal pass,
+        // then the three blurred channels of the row, which fit in another width floats
+        float *column = Scratch<float>(SCRATCH_ROWS, 3 * width + 2 * radius);
+        float *total = column + width + 2 * radius;
+        Component *blurred = (Component*) (total + width);
+        
+        for (int j = y0; j < y1; j++) {
+            for (int c = 0; c < 3; c++) {
+                
+                // vertical pass - weighted sum of the rows around j, extending the top/bottom rows past the edges
+                fill(column, column + width + 2 * radius, 0.0f);
+                
+                for (int k = -radius; k <= radius; k++) {
+                    const Component *src = originalImage.Row(c, min(max(j + k, 0), height - 1)) - radius;
+                    MultiplyAddSpan(column, src, kernel[k + radius], width + 2 * radius);
+                }
+                
+                // horizontal pass, a tap at a time across the whole row
+                fill(total, total + width, 0.0f);
+                
+                for (int k = 0; k < taps; k++) {
+                    MultiplyAddSpan(total, column + k, kernel[k], width);
+                }
+                
+                RoundSpan(total, &blurred[c * width], width);
+            }
+            
+            // alpha is left alone
+            InterleaveSpan(&blurred[0], &blurred[width], &blurred[2 * width], originalImage.Row(IMAGE_CHANNEL_ALPHA, j), Row(j), width);
+        }
+    });
     
+    MarkDirty();
+}
 
-    // for use after all pixels are read
-    int filterTotalNumberOfElements = n * n;
+
+void Image::BoxBlur(int radius, int passes) {
+    if (radius <= 0) {
+        return;
+    }
     
-    // actual convolution
-    // go through each location in the image
+    // the columns each box covers, and 1 / how many of them there are, which is the same for every row
+    double *columnWeight = Scratch<double>(SCRATCH_TABLE, 2 * width);
+    int *left = (int*) (columnWeight + width), *right = left + width;
     for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            
-            // location of intermediate values after multiplication
-            Pixel currentlyMultipliedByFilter[n][n];
-            
-            // so the correct location in the image is multiplied by the corresponding filter location - increment by 1 as necessary
-            int currentImageLocationForFilterX = -1 * n / 2;
-            int currentImageLocationForFilterY = -1 * n / 2;
-            
-            // go through each location in the filter and multiply
-            for (int k = 0; k < n; k++) {
-                for (int l = 0; l < n; l++) {
-                    
-                    // take care of the edges by extending the pixels closest to the edges
-                    // start with default locations
-                    int xLocationInImageToMultiply = i + currentImageLocationForFilterX;
-                    int yLocationInImageToMultiply = j + currentImageLocationForFilterY;
-                    
-                    // if x goes off the left edge
-                    if (i + currentImageLocationForFilterX < 0) {
-                        xLocationInImageToMultiply = 0;
-                        
-                    // if x goes off the right edge
-                    } else if (i + currentImageLocationForFilterX >= width) {
-                        xLocationInImageToMultiply = width - 1;
-                    }
-                    
-                    // if y goes off the top edge
-                    if (j + currentImageLocationForFilterY < 0) {
-                        yLocationInImageToMultiply = 0;
-                        
-                    // if y goes off the bottom edge
-                    } else if (j + currentImageLocationForFilterY >= height) {
-                        yLocationInImageToMultiply = height - 1;
-                    }
+        left[i] = max(i - radius, 0);
+        right[i] = min(i + radius + 1, width);
+        columnWeight[i] = 1.0 / (right[i] - left[i]);
+    }
+    
+    for (int pass = 0; pass < passes; pass++) {
+        // the table is a snapshot of the image, so the pass can write straight back into it
+        SummedAreaTable table(*this, SCRATCH_SNAPSHOT);
+        Unshare(false);
+        
+        ParallelFor(0, height, [&](int y0, int y1) {
+            for (int j = y0; j < y1; j++) {
+                int top = max(j - radius, 0);
+                int bottom = min(j + radius + 1, height);
+                double rowWeight = 1.0 / (bottom - top);
+                
+                const uint32_t *above = table.Row(top);
+                const uint32_t *below = table.Row(bottom);
+                Pixel *dst = Row(j);
+                
+                for (int i = 0; i < width; i++) {
+                    int x0 = 4 * left[i], x1 = 4 * right[i];
+                    double weight = columnWeight[i] * rowWeight;
                     
-                    // the corrected locations get passed to the multiplication so it always will work
-                    currentlyMultipliedByFilter[k][l] = originalImage->GetPixel(xLocationInImageToMultiply, yLocationInImageToMultiply) * filter[k][l];
+                    // box totals out of the four corners
+                    uint32_t red   = below[x1]     - below[x0]     - above[x1]     + above[x0];
+                    uint32_t green = below[x1 + 1] - below[x0 + 1] - above[x1 + 1] + above[x0 + 1];
+                    uint32_t blue  = below[x1 + 2] - below[x0 + 2] - above[x1 + 2] + above[x0 + 2];
                     
-                    currentImageLocationForFilterY++;
+                    dst[i].r = (Component) (red * weight + 0.5);
+                    dst[i].g = (Component) (green * weight + 0.5);
+                    dst[i].b = (Component) (blue * weight + 0.5);
                 }
-                currentImageLocationForFilterX++;
             }
-            
-            // due to clamping, averaging the components needs to be done by channel (ignoring alpha)
-            int redTotal = 0;
-            int greenTotal = 0;
-            int blueTotal = 0;
-            
-            for (int k = 0; k < n; k++) {
-                for (int l = 0; l < n; l++) {
-                    redTotal += ComponentClamp(currentlyMultipliedByFilter[k][l].r);
-                    greenTotal += ComponentClamp(currentlyMultipliedByFilter[k][l].g);
-                    blueTotal += ComponentClamp(currentlyMultipliedByFilter[k][l].b);
-                }
-            }
-            
-            
-            // actually take the averages - no clamping should be needed as all the original values are between 0 and 255
-            redTotal /= filterTotalNumberOfElements;
-            greenTotal /= filterTotalNumberOfElements;
-            blueTotal /= filterTotalNumberOfElements;
-            
-            // finally, put it back in the original
-            GetPixel(i, j).r = redTotal;
-            GetPixel(i, j).g = greenTotal;
-            GetPixel(i, j).b = blueTotal;
-        }
+        });
+    }
+    
+    MarkDirty();
+}
+
+
+void Image::FastBlur(double sigma) {
+    const int passes = 3;
+    int radii[passes];
+    GaussianBoxRadii(sigma, passes, radii);
+    
+    for (int pass = 0; pass < passes; pass++) {
+        BoxBlur(radii[pass]);
     }
 }
 
 
 // TODO: test this once blur is implemented; I'm not sure if the interpolation amount will work
 void Image::Sharpen(int n) {
-    // we need to have a blurred copy of the image to work with
+    // we need to have a blurred copy of the image to work with.  The copy shares the pixels, and Blur moves it onto
+    // pixels of its own, so nothing gets copied
     Image blurredImage = Image(*this);
     blurredImage.Blur(n);
+    blurredImage.Unshare();
+    const Image& original = *this;
     
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            // I think the top one is the correct one (bottom one produces an all-black image)
-            GetPixel(i, j) = PixelLerp(blurredImage.GetPixel(i, j), GetPixel(i, j), 2);
-            //GetPixel(i, j) = PixelLerp(GetPixel(i, j), blurredImage.GetPixel(i, j), 2);
+    ParallelFor(0, height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            // extrapolate away from the blurred version, into the blurred copy's pixels, which then become the image's
+            LerpSpan(blurredImage.Row(y), original.Row(y), blurredImage.Row(y), width, 2);
         }
-    }
+    });
+    
+    SwapPixels(blurredImage);
+    MarkDirty();
 }
 
 
 void Image::EdgeDetect() {
     
-    // when doing the convolution math, we always need to pull from the original image, not the partially edge detected version of the original image
-    Image *originalImage = new Image(*this);
+    // when doing the convolution math, we always need to pull from the original image, not the partially edge detected version of the original image.
+    // the copy is planar and padded by a pixel on each side, extending the pixels closest to the left/right edges
+    PlanarImage originalImage(width, height, 1, SCRATCH_SNAPSHOT);
+    originalImage.Load(*this);
     
+    // every pixel is written from the copy, so pixels shared with another image aren't copied first, just left to it
+    Unshare(false);
     
-    const int n = 3;
-
-    // the filter for edge detect is always the same
-    float filter[n][n] = {{ -1, -1, -1 },
-                          { -1, 8, -1 },
-                          { -1, -1, -1 }};
-    
-    int filterTotalNumberOfElements = n * n;
+    // the filter for edge detect is always the same: 8 times the center, minus each of its 8 neighbors
+    const int filterTotalNumberOfElements = 9;
     
-    // actual convolution - this section is identical to the blur code
-    // go through each location in the image
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            
-            // location of intermediate values after multiplication
-            float currentlyMultipliedByFilterRed[n][n];
-            float currentlyMultipliedByFilterGreen[n][n];
-            float currentlyMultipliedByFilterBlue[n][n];
-            
-            // so the correct location in the image is multiplied by the corresponding filter location - increment by 1 as necessary
-            int currentImageLocationForFilterX = -1 * n / 2;
-            int currentImageLocationForFilterY = -1 * n / 2;
-            
-            // go through each location in the filter and multiply
-            for (int k = 0; k < n; k++) {
-                for (int l = 0; l < n; l++) {
-                    
-                    // take care of the edges by extending the pixels closest to the edges
-                    // start with default locations
-                    int xLocationInImageToMultiply = i + currentImageLocationForFilterX;
-                    int yLocationInImageToMultiply = j + currentImageLocationForFilterY;
-                    
-                    // if x goes off the left edge
-                    if (i + currentImageLocationForFilterX < 0) {
-                        xLocationInImageToMultiply = 0;
-                        
-                        // if x goes off the right edge
-                    } else if (i + currentImageLocationForFilterX >= width) {
-                        xLocationInImageToMultiply = width - 1;
-                    }
-                    
-                    // if y goes off the top edge
-                    if (j + currentImageLocationForFilterY < 0) {
-                        yLocationInImageToMultiply = 0;
-                        
-                        // if y goes off the bottom edge
-                    } else if (j + currentImageLocationForFilterY >= height) {
-                        yLocationInImageToMultiply = height - 1;
-                    }
-                    
-                    // the corrected locations get passed to the multiplication so it always will work
-
-                    // where I tried multiplying each channel individually so I knew that no clamping should be happening
-                    currentlyMultipliedByFilterRed[k][l] = (originalImage->GetPixel(xLocationInImageToMultiply, yLocationInImageToMultiply).r) / 255.0 * filter[k][l];
-                    currentlyMultipliedByFilterGreen[k][l] = (originalImage->GetPixel(xLocationInImageToMultiply, yLocationInImageToMultiply).g) / 255.0 * filter[k][l];
-                    currentlyMultipliedByFilterBlue[k][l] = (originalImage->GetPixel(xLocationInImageToMultiply, yLocationInImageToMultiply).b) / 255.0 * filter[k][l];
+    // actual convolution - go through each location in the image
+    ParallelFor(0, height, [&](int y0, int y1) {
+        Component *edges = Scratch<Component>(SCRATCH_ROWS, width * 3);
+        
+        for (int j = y0; j < y1; j++) {
+            for (int c = 0; c < 3; c++) {
+                
+                // the rows above and below, extending the pixels closest to the top/bottom edges
+                const Component *above = originalImage.Row(c, max(j - 1, 0));
+                const Component *center = originalImage.Row(c, j);
+                const Component *below = originalImage.Row(c, min(j + 1, height - 1));
+                Component *dst = &edges[c * width];
+                
+                for (int i = 0; i < width; i++) {
+                    // the channel's total (ignoring alpha), in units of 1/255
+                    int total = 8 * center[i] - (above[i - 1] + above[i] + above[i + 1] +
+                                                 center[i - 1] + center[i + 1] +
+                                                 below[i - 1] + below[i] + below[i + 1]);
                     
-                    currentImageLocationForFilterY++;
-                }
-                currentImageLocationForFilterX++;
-            }
-            
-            // due to clamping, averaging the components needs to be done by channel (ignoring alpha)
-            float redTotal = 0.0;
-            float greenTotal = 0.0;
-            float blueTotal = 0.0;
-            
-            for (int k = 0; k < n; k++) {
-                for (int l = 0; l < n; l++) {
-                    redTotal += currentlyMultipliedByFilterRed[k][l];
-                    greenTotal += currentlyMultipliedByFilterGreen[k][l];
-                    blueTotal += currentlyMultipliedByFilterBlue[k][l];
+                    // clamp the filter response, then average it over the filter and put it back in the original.
+                    // the response is at most 8, so doing this in integers gives the same values the float math did
+                    int response = max(total, 0) / 255;
+                    dst[i] = response * 255 / filterTotalNumberOfElements;
                 }
             }
             
-            redTotal = ComponentClamp(redTotal);
-            greenTotal = ComponentClamp(greenTotal);
-            blueTotal = ComponentClamp(blueTotal);
-            
-            
-            // actually take the averages - no clamping should be needed as all the original values are between 0 and 255
-            redTotal /= filterTotalNumberOfElements;
-            greenTotal /= filterTotalNumberOfElements;
-            blueTotal /= filterTotalNumberOfElements;
-            
-            // finally, put it back in the original
-            GetPixel(i, j).r = ComponentClamp(redTotal * 255.0);
-            GetPixel(i, j).g = ComponentClamp(greenTotal * 255.0);
-            GetPixel(i, j).b = ComponentClamp(blueTotal * 255.0);
+            InterleaveSpan(&edges[0], &edges[width], &edges[2 * width], originalImage.Row(IMAGE_CHANNEL_ALPHA, j), Row(j), width);
         }
+    });
+    
+    MarkDirty();
+}
+
+// The mip level with the fewest pixels that's still at least as big as the image shrunk by factor
+static int ShrinkLevel (const Image& img, double factor) {
+    int level = 0;
+    while (level + 1 < img.MipLevels() && factor * (2 << level) <= 1) {
+        level++;
     }
+    return level;
 }
 
-// TODO: test this function; it should be complete, but Sample isn't implemented yet, so I can't test it
-Image* Image::Scale(double sx, double sy) {
-    
-    // we need to an image the size of what the current image is after it's scaled
-    Image *scaledImage = new Image(width * sx, height * sy);
-    
-    for (int i = 0; i < scaledImage->width; i++) {
-        for (int j = 0; j < scaledImage->height; j++) {
-            scaledImage->GetPixel(i, j) = Sample(i / sx, j / sy);
-        }
+// True if m turns a width x height image about its center onto the canvas RotateAboutCenter would make, w x h
+static bool IsCenteredRotation (const double m[6], int width, int height, int w, int h, double *angle) {
+    if (fabs(m[0] - m[4]) > 1e-9 || fabs(m[1] + m[3]) > 1e-9 || fabs(m[0] * m[0] + m[3] * m[3] - 1) > 1e-9) {
+        return false;
+    }
+    if (fabs(m[0] * width / 2 + m[1] * height / 2 + m[2] - w / 2.0) > 1e-6 ||
+        fabs(m[3] * width / 2 + m[4] * height / 2 + m[5] - h / 2.0) > 1e-6) {
+        return false;
     }
     
-    return scaledImage;
+    *angle = atan2(m[3], m[0]);
+    int rotatedWidth, rotatedHeight;
+    RotatedSize(width, height, *angle, &rotatedWidth, &rotatedHeight);
+    return rotatedWidth == w && rotatedHeight == h;
 }
 
-// TODO: test this function; it should be complete, but Sample isn't implemented yet, so I can't test it
-Image* Image::Rotate(double angle) {
+Image Image::Affine(const double m[6], int w, int h, const vector<AffineWindow> *windows) {
+    double inverse[6];
+    if (!InvertAffine(m, inverse)) {
+        printf("Error: affine map squashes the image flat");
+        exit(-1);
+    }
+    
+    if (w <= 0 || h <= 0) {
+        AffineBounds(m, width, height, &w, &h);
+    }
     
-    // just make a really large image
-    Image *rotatedImage = new Image(1000, 1000);
+    // turning the whole image about its center is exact for quarter turns, and shears otherwise (see Rotate.h).
+    // Neither of those (nor the scales below) knows about windows
+    bool windowed = windows != NULL && !windows->empty();
+    double angle;
+    if (!windowed && IsCenteredRotation(m, width, height, w, h, &angle)) {
+        return RotateAboutCenter(*this, angle, sampling_method != IMAGE_SAMPLING_POINT);
+    }
     
-    for (int i = 0; i < rotatedImage->width; i++) {
-        for (int j = 0; j < rotatedImage->height; j++) {
-            rotatedImage->GetPixel(i, j) = Sample(i * cos(-1 * angle) - j * sin(-1 * angle),
-                                                  i * sin(-1 * angle) + j * cos(-1 * angle));
+    Image warped(w, h);
+    
+    // shrinking by 2x or more reads from the mip level with the fewest pixels that's still at least as big
+    // as the result, so sampling doesn't skip over detail.  sx and sy are how much source rows and columns stretch.
+    // Each level pixel covers 2^level source pixels, even the odd one at the end, so positions scale by exactly that
+    double sx = hypot(m[0], m[3]), sy = hypot(m[1], m[4]);
+    int level = ShrinkLevel(*this, max(sx, sy));
+    const Image& src = MipLevel(level);
+    double n[6] = { m[0] * (1 << level), m[1] * (1 << level), m[2],
+                    m[3] * (1 << level), m[4] * (1 << level), m[5] };
+    
+    // point and bilinear scales have row-at-a-time versions (see Resample.h)
+    if (!windowed && n[1] == 0 && n[3] == 0 && n[2] == 0 && n[5] == 0 && n[0] > 0 && n[4] > 0) {
+        if (sampling_method == IMAGE_SAMPLING_POINT) {
+            ScalePoint(src, n[0], n[4], warped);
+            return warped;
+        }
+        if (sampling_method == IMAGE_SAMPLING_BILINEAR && src.width >= 2) {
+            ScaleBilinear(src, n[0], n[4], warped);
+            return warped;
         }
     }
     
+    WarpAffine(src, n, sampling_method, warped, windows);
+    return warped;
+}
+
+Image Image::Scale(double sx, double sy, int filter) {
+    assert(filter >= 0 && filter < IMAGE_N_FILTERS);
     
+    // we need to an image the size of what the current image is after it's scaled
+    int w = max((int) (width * sx), 1), h = max((int) (height * sy), 1);
+    
+    if (filter == IMAGE_FILTER_NONE) {
+        double m[6] = { sx, 0, 0, 0, sy, 0 };
+        return Affine(m, w, h);
+    }
     
-    return rotatedImage;
+    // a filter already covers every source pixel, so it gets a mip level twice the size sampling would,
+    // which keeps it doing some of the shrinking (see Resample.h)
+    Image scaledImage(w, h);
+    int level = max(ShrinkLevel(*this, max(sx, sy)) - 1, 0);
+    ScaleFiltered(MipLevel(level), sx * (1 << level), sy * (1 << level), filter, scaledImage);
+    return scaledImage;
+}
+
+Image Image::Rotate(double angle) {
+    // about the center, onto a canvas just big enough for the whole result
+    double m[6];
+    int w, h;
+    CenteredRotation(width, height, angle, m, &w, &h);
+    return Affine(m, w, h);
 }
 
 
 void Image::Fun() {
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            GetPixel(i, j) = Sample(pow(i, 2), pow(j, 3));
+    // reading from a copy leaves the rows free to be written in any order
+    TiledImage source(*this);
+    Unshare(false);
+    
+    ParallelFor(0, height, [&](int j0, int j1) {
+        for (int j = j0; j < j1; j++) {
+            Pixel *dst = Row(j);
+            
+            for (int i = 0; i < width; i++) {
+                dst[i] = SamplePixel(source, pow(i, 2), pow(j, 3), sampling_method);
+            }
         }
-    }
+    });
+    
+    MarkDirty();
 }
 
 /**
@@ -582,26 +1007,6 @@ void Image::SetSamplingMethod(int method)
     sampling_method = method;
 }
 
-// TODO: finish this
 Pixel Image::Sample (double u, double v){
-    
-    
-    switch (sampling_method) {
-        case IMAGE_SAMPLING_POINT:
-            return GetPixel(u, v);
-            break;
-            
-        case IMAGE_SAMPLING_BILINEAR:
-            /*int uCeiling = ceil(u);
-            int uFloor = floor(u);
-            int vCeiling = ceil(v);
-            int vFloor = ceil(v);*/
-            
-            //return PixelLerp(GetPixel(floor(u), floor(v)), GetPixel(ceil(u), ceil(v)), <#double t#>)
-            break;
-            
-        case IMAGE_SAMPLING_GAUSSIAN:
-            break;
-    }
-    return Pixel();
+    return SamplePixel(*this, u, v, sampling_method);
 }
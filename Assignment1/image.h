@@ -17,8 +17,15 @@
 #define IMAGE_INCLUDED
 
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
+#include <vector>
+#include <atomic>
 #include "pixel.h"
+#include "imagestats.h"
+
+class MipPyramid;
+struct AffineWindow;
 
 
 #include "stb_image.h"
@@ -34,6 +41,17 @@ enum {
     IMAGE_N_SAMPLING_METHODS
 };
 
+// Kernels Scale can filter with instead of sampling (see Resample.h)
+enum {
+    IMAGE_FILTER_NONE,          // sample with the sampling method
+    IMAGE_FILTER_BOX,
+    IMAGE_FILTER_TRIANGLE,
+    IMAGE_FILTER_CATMULL_ROM,
+    IMAGE_FILTER_MITCHELL,
+    IMAGE_FILTER_LANCZOS3,
+    IMAGE_N_FILTERS
+};
+
 enum {
     IMAGE_CHANNEL_RED,
     IMAGE_CHANNEL_GREEN,
@@ -43,6 +61,21 @@ enum {
 };
 
 
+/**
+ * Pixel memory that any number of Images can look into: a copy of an Image
+ * starts out on the same buffer, and a Crop is a window into it.  The last
+ * Image to let go of it frees it, with whatever goes with where it came
+ * from (the buffer pool, or stbi_load's malloc).
+ **/
+struct PixelBuffer
+{
+    std::atomic<int> references;
+    uint8_t *raw;
+    size_t bytes;
+    void (*release) (void *raw, size_t bytes);     // gives raw back to what it came from
+};
+
+
 /**
  * Image
  **/
@@ -57,30 +90,85 @@ public:
         uint8_t *raw;
     };
     
-    PixelData data;
+    PixelData data;         // the image's first pixel, somewhere in buffer
     //PixelInfo *pixels; //pixel array
     //uint8_t *pixelData;
     int width, height, num_pixels;
+    int stride;             // pixels from the start of one row to the start of the next, width unless the image is a view
     int sampling_method;
+    PixelBuffer *buffer;    // shared with any copy or Crop of the image, or the image it's a copy or Crop of
+    mutable ImageStats *stats;  // NULL until Stats() is called, and again once the pixels change
+    mutable MipPyramid *pyramid;    // NULL until MipLevel() is called, and again once the pixels change
     //BMP* bmpImg;
     
 public:
+    // Creates an empty (0 x 0) image with no pixels, to assign an image to later
+    Image ();
+    
     // Creates a blank image with the given dimensions
     Image (int width, int height);
     
-    // Copy iamage
+    // Copy iamage - the copy shares src's pixels until one of the two changes them
     Image (const Image& src);
+    Image& operator= (const Image& src);
+    
+    // Move image - takes src's pixels over, leaving src empty
+    Image (Image&& src);
+    Image& operator= (Image&& src);
     
     // Make image from file
     Image(char *fname);
     
+    // Replaces the image with the one in fname; false (leaving the image as it was) if it can't be read
+    bool Load (char *fname);
+    
     // Destructor
     ~Image ();
     
-    // Pixel access
+    // Pixel access - the non-const versions are for writing, so the image has to have its pixels to itself (see Unshare)
     int ValidCoord (int x, int y)  const { return x>=0 && x<width && y>=0 && y<height; }
-    Pixel& GetPixel (int x, int y) const { assert(ValidCoord(x,y));  return data.pixels[y*width + x]; }
-    void SetPixel (int x, int y, Pixel p) const { assert(ValidCoord(x,y));  data.pixels[y*width + x] = p; }
+    const Pixel& GetPixel (int x, int y) const { assert(ValidCoord(x,y));  return data.pixels[(size_t) y*stride + x]; }
+    Pixel& GetPixel (int x, int y) { assert(ValidCoord(x,y) && Unshared());  return data.pixels[(size_t) y*stride + x]; }
+    void SetPixel (int x, int y, Pixel p) { assert(ValidCoord(x,y) && Unshared());  data.pixels[(size_t) y*stride + x] = p; }
+    
+    // Row access - pointer to the first pixel of row y, the rest of the row follows contiguously (but not the next row, see Stride)
+    const Pixel* Row (int y) const { assert(y>=0 && y<height);  return data.pixels + (size_t) y*stride; }
+    Pixel* Row (int y) { assert(y>=0 && y<height && Unshared());  return data.pixels + (size_t) y*stride; }
+    int Stride () const { return stride; }
+    
+    // True if no copy or Crop shares the image's pixels, so they can be written
+    bool Unshared () const { return buffer != NULL && buffer->references == 1; }
+    
+    /**
+     * Gives the image pixels of its own if it shares its buffer (with a copy
+     * or Crop of it, or the image it's a copy or Crop of), so that writing
+     * to them doesn't show through in the other one.  Every Image method
+     * that changes pixels calls it first, and the non-const GetPixel,
+     * SetPixel and Row assert that it has been.  Without keep the new pixels aren't
+     * filled in, for a filter that's about to write every one of them from
+     * a snapshot it already took.
+     **/
+    void Unshare (bool keep = true);
+    
+    // Trades pixels with other, which has to be the same size; the caller calls MarkDirty on both
+    void SwapPixels (Image& other);
+    
+    /**
+     * Histograms, mean, min and max of the image, worked out the first time
+     * they're needed and then kept.  Every Image method that changes pixels
+     * calls MarkDirty when it's done; code that changes them itself (through
+     * GetPixel, SetPixel, Row or data) has to call it too.
+     **/
+    const ImageStats& Stats () const;
+    void MarkDirty ();
+    
+    /**
+     * Level of the image's mip pyramid (see Mip.h): 0 is the image itself,
+     * and each level after that is half the size of the one before, down to
+     * 1x1.  Levels are built as they're needed and kept, like Stats().
+     **/
+    const Image& MipLevel (int level) const;
+    int MipLevels () const;
     
     // Dimension access
     int Width     () const { return width; }
@@ -88,7 +176,7 @@ public:
     int NumPixels () const { return num_pixels; }
     
     // Make file from image
-    void Write( char *fname );
+    void Write( char *fname ) const;
     
     // Adds noise to an image.  The amount of noise is given by the factor
     // in the range [0.0..1.0].  0.0 adds no noise.  1.0 adds a lot of noise.
@@ -97,6 +185,9 @@ public:
     // Brightens the image by multiplying each pixel component by the factor.
     void Brighten (double factor);
     
+    // Returns the mean luminance of the image (from Stats())
+    float MeanLuminance ();
+    
     /**
      * Changes the contrast of an image by interpolating between the image
      * and a constant gray image with the average luminance.
@@ -113,12 +204,26 @@ public:
      **/
     void ChangeSaturation (double factor);
     
+    /**
+     * Equalizes the histogram of the image's luminance: the curve that spreads
+     * the luminance levels out evenly over [0..255] is applied to red, green
+     * and blue alike.  Alpha is left alone.
+     **/
+    void Equalize ();
+    
+    /**
+     * Stretches each of red, green and blue separately so its values span
+     * [0..255], ignoring the clip fraction of pixels at each end (so a few
+     * stray pixels don't stop the rest from being stretched).
+     **/
+    void AutoLevels (double clip = 0.005);
+    
     /**
      * Extracts a sub image from the image, at position (x, y), width w,
-     * and height h.
-     * Note: Returned Image instance is dynamically allocated, so the user of the method must take care of releasing the memory
+     * and height h.  Nothing is copied: the result is a view into this
+     * image's pixels, with its stride, until one of the two is written to.
      **/
-    Image* Crop(int x, int y, int w, int h);
+    Image Crop(int x, int y, int w, int h);
     
     /**
      * Extracts a channel of an image.  Leaves the specified channel
@@ -136,8 +241,24 @@ public:
     
     
     
-    // Blurs an image with an n x n Gaussian filter.
-    void Blur(int n);
+    /**
+     * Blurs an image with an n x n Gaussian filter of standard deviation sigma.
+     * The filter is separable, so it's applied as a vertical and then a horizontal
+     * 1D pass, which costs 2n taps per pixel instead of n * n.
+     * An even n is rounded up to the next odd size; sigma <= 0 picks one to fit n.
+     **/
+    void Blur(int n, double sigma = 0.0);
+    
+    /**
+     * Blurs an image with a (2 * radius + 1) square box filter, passes times
+     * over.  Each pass averages out of a summed-area table, so it costs the same
+     * per pixel however big the radius is.  Near the edges the box only averages
+     * the pixels inside the image.  Alpha is left alone, like Blur does.
+     **/
+    void BoxBlur(int radius, int passes = 1);
+    
+    // Approximates Blur with a Gaussian of standard deviation sigma by 3 box blurs, at a cost that doesn't depend on sigma
+    void FastBlur(double sigma);
     
     // Sharpens an image by blurring with an n x n Gaussian filter and then extrapolating
     void Sharpen(int n);
@@ -157,11 +278,35 @@ public:
      **/
     void FloydSteinbergDither(int nbits);
     
-    // Scales an image in x by sx, and y by sy.
-    Image* Scale(double sx, double sy);
+    /**
+     * Warps an image by the affine map m, which takes the source point (x, y)
+     * to (m[0] x + m[1] y + m[2], m[3] x + m[4] y + m[5]), onto a w x h canvas
+     * (by default, one that reaches wherever the image's corners land, from
+     * the origin).  Samples like Scale, black where nothing lands; see Warp.h.
+     * Scales and turns about the center take the faster paths Scale and
+     * Rotate describe, and shrinking by 2x or more reads from a mip level.
+     * Anything off any of the windows is black as well.
+     **/
+    Image Affine(const double m[6], int w = 0, int h = 0, const std::vector<AffineWindow> *windows = NULL);
+    
+    /**
+     * Scales an image in x by sx, and y by sy.  Point sampling takes the pixel
+     * at (i / sx, j / sy) for output pixel (i, j); the other methods sample
+     * under the output pixel's center, ((i + 0.5) / sx, (j + 0.5) / sy).
+     * Any filter but IMAGE_FILTER_NONE filters with that kernel instead of
+     * sampling.  Shrinking by 2x or more reads from a mip level (see MipLevel).
+     * Without a filter, this is Affine with m = { sx, 0, 0, 0, sy, 0 }.
+     **/
+    Image Scale(double sx, double sy, int filter = IMAGE_FILTER_NONE);
     
-    // Rotates an image by the given angle.
-    Image* Rotate(double angle);
+    /**
+     * Rotates an image by the given angle (in radians, clockwise on screen)
+     * about its center, onto a canvas just big enough to hold all of it, with
+     * black around it.  Whole quarter turns are exact; the rest is three
+     * shears (see Rotate.h), which blend neighbouring pixels for any sampling
+     * method but point.  This is Affine with that rotation.
+     **/
+    Image Rotate(double angle);
     
     // Warps an image using a creative filter of your choice.
     void Fun();
@@ -171,6 +316,67 @@ public:
     
     // Sample image using current sampling method.
     Pixel Sample(double u, double v);
+    
+private:
+    // A view of the w x h window of src at (x, y), sharing its buffer
+    Image (const Image& src, int x, int y, int w, int h);
 };
 
+/**
+ * Samples source at (u, v) with one of the IMAGE_SAMPLING methods.  source
+ * is anything with Width, Height, ValidCoord and GetPixel like Image's, so
+ * the filters can sample a TiledImage copy the same way as the image itself.
+ **/
+template <class Source>
+Pixel SamplePixel (const Source& source, double u, double v, int method) {
+    switch (method) {
+        case IMAGE_SAMPLING_POINT:
+            // anything outside the image is black
+            if (!source.ValidCoord(u, v)) {
+                return Pixel();
+            }
+            return source.GetPixel(u, v);
+            
+        case IMAGE_SAMPLING_BILINEAR: {
+            if (u < 0 || v < 0 || u >= source.Width() || v >= source.Height()) {
+                return Pixel();
+            }
+            
+            // pixel (x, y) covers [x, x + 1) x [y, y + 1), so its center is at (x + 0.5, y + 0.5).
+            // Past the outermost centers, the edge pixels are extended
+            double x = u - 0.5, y = v - 0.5;
+            int x0 = (int) floor(x), y0 = (int) floor(y);
+            double fx = x - x0, fy = y - y0;
+            int x1 = x0 + 1 < source.Width()  ? x0 + 1 : x0;
+            int y1 = y0 + 1 < source.Height() ? y0 + 1 : y0;
+            x0 = x0 < 0 ? 0 : x0;
+            y0 = y0 < 0 ? 0 : y0;
+            
+            const Pixel& p00 = source.GetPixel(x0, y0);
+            const Pixel& p10 = source.GetPixel(x1, y0);
+            const Pixel& p01 = source.GetPixel(x0, y1);
+            const Pixel& p11 = source.GetPixel(x1, y1);
+            
+            double w00 = (1 - fx) * (1 - fy), w10 = fx * (1 - fy), w01 = (1 - fx) * fy, w11 = fx * fy;
+            return Pixel(ComponentClamp(p00.r * w00 + p10.r * w10 + p01.r * w01 + p11.r * w11 + 0.5),
+                         ComponentClamp(p00.g * w00 + p10.g * w10 + p01.g * w01 + p11.g * w11 + 0.5),
+                         ComponentClamp(p00.b * w00 + p10.b * w10 + p01.b * w01 + p11.b * w11 + 0.5),
+                         ComponentClamp(p00.a * w00 + p10.a * w10 + p01.a * w01 + p11.a * w11 + 0.5));
+        }
+            
+        case IMAGE_SAMPLING_GAUSSIAN:
+            break;
+    }
+    return Pixel();
+}
+
+// Fills kernel[0 .. 2 * radius] with a Gaussian of standard deviation sigma, normalized to add up to 1
+void GaussianKernel (int radius, double sigma, float *kernel);
+
+// Total bytes of pixel data allocated by Image constructors so far, on every thread
+long long ImageBytesAllocated ();
+
+// Number of pixel buffers those were, so a copy that only shares pixels doesn't count
+long long ImageBuffersAllocated ();
+
 #endif
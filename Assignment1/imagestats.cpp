@@ -0,0 +1,143 @@
+//
+//  imagestats.cpp
+//  Assignment1
+//
+
+#include "imagestats.h"
+#include "image.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+
+/**
+ * BandHistogram - the counts for one band of rows
+ *
+ *  Neighbouring pixels often have the same value, and incrementing the same
+ *  counter over and over stalls each increment until the last one's store
+ *  has gone through.  Building with -DHISTOGRAM_COPIES=4 counts every
+ *  channel into that many separate tables, pixel x into copy
+ *  x % HISTOGRAM_COPIES, and adds the copies together when the band is done.
+ *  That only pays off on flat images, and by very little; on noisy ones
+ *  (most photos) the bigger tables are slower, so the default is one.
+ **/
+#ifndef HISTOGRAM_COPIES
+#define HISTOGRAM_COPIES 1
+#endif
+
+struct BandHistogram
+{
+    // [copy][channel, or 4 for luminance][value]
+    uint32_t counts[HISTOGRAM_COPIES][5][256];
+    
+    BandHistogram () { memset(counts, 0, sizeof(counts)); }
+    
+    void Add (const Pixel *row, const Component *rowLuminance, int width) {
+        int x = 0;
+        for (; x + HISTOGRAM_COPIES <= width; x += HISTOGRAM_COPIES) {
+            for (int k = 0; k < HISTOGRAM_COPIES; k++) {
+                const Pixel& p = row[x + k];
+                counts[k][0][p.r]++;
+                counts[k][1][p.g]++;
+                counts[k][2][p.b]++;
+                counts[k][3][p.a]++;
+                counts[k][4][rowLuminance[x + k]]++;
+            }
+        }
+        for (; x < width; x++) {
+            counts[0][0][row[x].r]++;
+            counts[0][1][row[x].g]++;
+            counts[0][2][row[x].b]++;
+            counts[0][3][row[x].a]++;
+            counts[0][4][rowLuminance[x]]++;
+        }
+    }
+    
+    // Adds the counts into stats, and starts over from zero
+    void MergeInto (ImageStats& stats) {
+        for (int k = 0; k < HISTOGRAM_COPIES; k++) {
+            for (int v = 0; v < 256; v++) {
+                for (int c = 0; c < 4; c++) {
+                    stats.histogram[c][v] += counts[k][c][v];
+                }
+                stats.luminance[v] += counts[k][4][v];
+            }
+        }
+        memset(counts, 0, sizeof(counts));
+    }
+};
+
+
+void ImageStats::Compute (const Image& img) {
+    memset(histogram, 0, sizeof(histogram));
+    memset(luminance, 0, sizeof(luminance));
+    mutex merging;
+    
+    ParallelFor(0, img.Height(), [&](int y0, int y1) {
+        // each band counts into its own histograms, which get added in at the end - the order
+        // they're added in doesn't matter, so the result is the same however the rows are split
+        BandHistogram band;
+        vector<Component> rowLuminance(img.Width());
+        long long pending = 0;
+        
+        for (int y = y0; y < y1; y++) {
+            const Pixel *row = img.Row(y);
+            LuminanceSpan(row, &rowLuminance[0], img.Width());
+            band.Add(row, &rowLuminance[0], img.Width());
+            
+            // every copy's 32 bit counts have to be added in before they can overflow
+            pending += img.Width();
+            if (pending > (1LL << 31)) {
+                lock_guard<mutex> held(merging);
+                band.MergeInto(*this);
+                pending = 0;
+            }
+        }
+        
+        lock_guard<mutex> held(merging);
+        band.MergeInto(*this);
+    });
+    
+    // everything else comes out of the histograms
+    long long pixels = img.NumPixels();
+    long long luminanceTotal = 0;
+    for (int v = 0; v < 256; v++) {
+        luminanceTotal += v * luminance[v];
+    }
+    meanLuminance = (float) luminanceTotal / pixels;
+    
+    for (int c = 0; c < 4; c++) {
+        long long total = 0;
+        min[c] = 255;
+        max[c] = 0;
+        
+        for (int v = 0; v < 256; v++) {
+            if (histogram[c][v] > 0) {
+                min[c] = v < min[c] ? v : min[c];
+                max[c] = v;
+            }
+            total += v * histogram[c][v];
+        }
+        mean[c] = (float) total / pixels;
+    }
+}
+
+
+void ImageStats::Write (const char *fname) const {
+    FILE *file = fopen(fname, "w");
+    if (file == NULL) {
+        printf("Error writing histogram: %s", fname);
+        exit(-1);
+    }
+    
+    fprintf(file, "value,red,green,blue,alpha,luminance\n");
+    for (int v = 0; v < 256; v++) {
+        fprintf(file, "%d,%lld,%lld,%lld,%lld,%lld\n", v, histogram[0][v], histogram[1][v], histogram[2][v],
+                histogram[3][v], luminance[v]);
+    }
+    fclose(file);
+}
@@ -0,0 +1,35 @@
+//ImageStats.h
+//
+//Histograms and summary statistics of an image
+//
+//  Image::Stats() works these out the first time they're asked for and
+//  keeps them until the pixels change, so operations driven by statistics
+//  (contrast, auto levels, equalization, ...) don't each rescan the image.
+
+#ifndef IMAGESTATS_INCLUDED
+#define IMAGESTATS_INCLUDED
+
+#include "pixel.h"
+
+class Image;
+
+struct ImageStats
+{
+    // How many pixels have each value, per channel (IMAGE_CHANNEL_RED to IMAGE_CHANNEL_ALPHA)
+    long long histogram[4][256];
+
+    // How many pixels have each Pixel::Luminance
+    long long luminance[256];
+
+    float mean[4];
+    float meanLuminance;
+    Component min[4], max[4];
+
+    // Works everything out for img in one pass, on the thread pool
+    void Compute (const Image& img);
+    
+    // Writes the histograms as CSV, one row per value: value,red,green,blue,alpha,luminance
+    void Write (const char *fname) const;
+};
+
+#endif
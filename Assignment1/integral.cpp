@@ -0,0 +1,87 @@
+//
+//  integral.cpp
+//  Assignment1
+//
+
+#include "integral.h"
+#include "image.h"
+#include "parallel.h"
+#include "bufferpool.h"
+#include "scratch.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+using namespace std;
+
+
+/**
+ * SummedAreaTable
+ **/
+SummedAreaTable::SummedAreaTable (const Image& img, int scratchSlot) {
+    width = img.Width();
+    height = img.Height();
+    stride = (size_t) (width + 1) * 4;
+    
+    scratch = scratchSlot >= 0;
+    if (scratch) {
+        table = Scratch<uint32_t>(scratchSlot, stride * (height + 1));
+    } else {
+        table = (uint32_t*) PoolAllocate(stride * (height + 1) * sizeof(uint32_t));
+    }
+    memset(table, 0, stride * sizeof(uint32_t));
+    
+    // running totals along each row first, which the rows can do independently...
+    ParallelFor(0, height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            const Pixel *src = img.Row(y);
+            uint32_t *dst = table + (y + 1) * stride;
+            uint32_t r = 0, g = 0, b = 0, a = 0;
+            
+            dst[0] = dst[1] = dst[2] = dst[3] = 0;
+            for (int x = 0; x < width; x++) {
+                dst += 4;
+                dst[0] = r += src[x].r;
+                dst[1] = g += src[x].g;
+                dst[2] = b += src[x].b;
+                dst[3] = a += src[x].a;
+            }
+        }
+    });
+    
+    // ...then down each column, which the columns can
+    ParallelFor(0, (int) stride, [&](int x0, int x1) {
+        for (int y = 1; y <= height; y++) {
+            const uint32_t *above = table + (y - 1) * stride;
+            uint32_t *row = table + y * stride;
+            
+            for (int x = x0; x < x1; x++) {
+                row[x] += above[x];
+            }
+        }
+    });
+}
+
+
+SummedAreaTable::~SummedAreaTable () {
+    if (!scratch) {
+        PoolRelease(table, stride * (height + 1) * sizeof(uint32_t));
+    }
+}
+
+
+void GaussianBoxRadii (double sigma, int passes, int *radii) {
+    // the widest odd width that's no wider than ideal, and the next odd width up
+    double ideal = sqrt(12.0 * sigma * sigma / passes + 1.0);
+    int lower = (int) floor(ideal);
+    if (lower % 2 == 0) {
+        lower--;
+    }
+    int upper = lower + 2;
+    
+    // how many passes use the narrower width, so the variances add up as close to sigma^2 as they can
+    int narrow = (int) floor((12.0 * sigma * sigma - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes) / (-4.0 * lower - 4.0) + 0.5);
+    
+    for (int i = 0; i < passes; i++) {
+        radii[i] = ((i < narrow ? lower : upper) - 1) / 2;
+    }
+}
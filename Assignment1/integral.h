@@ -0,0 +1,58 @@
+//Integral.h
+//
+//Summed-area table (integral image)
+//
+//  Entry (x, y) holds the per channel totals of every pixel above and to the
+//  left of pixel (x, y), so the total over any rectangle takes four lookups
+//  however big the rectangle is.  The totals are 32 bit and are allowed to
+//  wrap around: differences of wrapped totals still come out right as long
+//  as the rectangle's own total fits in 32 bits, which holds for any
+//  rectangle of up to 16 million pixels.
+
+#ifndef INTEGRAL_INCLUDED
+#define INTEGRAL_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Image;
+
+class SummedAreaTable
+{
+public:
+    // Builds the table for img, on the thread pool, in the calling thread's scratch memory for scratchSlot if it's given (see Scratch.h)
+    SummedAreaTable (const Image& img, int scratchSlot = -1);
+    ~SummedAreaTable ();
+
+    /**
+     * Row y (0 to the image height, inclusive) of the table.  Entry x (0 to the
+     * image width, inclusive) is at Row(y) + 4 * x, and holds the r, g, b and a
+     * totals of the pixels [0, x) x [0, y).
+     **/
+    const uint32_t* Row (int y) const { return table + (size_t) y * stride; }
+
+    // Total of channel c over the pixels [x0, x1) x [y0, y1)
+    uint32_t Sum (int c, int x0, int y0, int x1, int y1) const {
+        const uint32_t *top = Row(y0), *bottom = Row(y1);
+        return bottom[4 * x1 + c] - bottom[4 * x0 + c] - top[4 * x1 + c] + top[4 * x0 + c];
+    }
+
+private:
+    // no copying
+    SummedAreaTable (const SummedAreaTable&);
+    void operator= (const SummedAreaTable&);
+
+    uint32_t *table;
+    bool scratch;       // table belongs to the thread's scratch memory, not to the SummedAreaTable
+    int width, height;
+    size_t stride;      // entries from one row to the next
+};
+
+/**
+ * Radii of the passes of a box blur that approximates a Gaussian of the given
+ * standard deviation (the box widths whose repeated convolution has the same
+ * variance, as close as whole odd widths allow).
+ **/
+void GaussianBoxRadii (double sigma, int passes, int *radii);
+
+#endif
@@ -12,10 +12,20 @@
 
 
 #include "image.h"
+#include "chain.h"
+#include "parallel.h"
+#include "stream.h"
+#include "profile.h"
+#include "bufferpool.h"
+#include "scratch.h"
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
 
 
 #define STB_IMAGE_IMPLEMENTATION //only place once in one .cpp file
@@ -33,10 +43,17 @@ using namespace std;
  **/
 static void ShowUsage(void);
 static void CheckOption(char *option, int argc, int minargc);
+static int RunBatch(const char *manifest, const Chain& chain, int jobs, int format);
 
 int main( int argc, char* argv[] ){
-	Image *img = NULL;
+	Chain chain;
+	bool have_input = false;
 	bool did_output = false;
+	int stream_rows = 0;
+	char *batch_manifest = NULL;
+	int batch_jobs = 0;
+	char *profile_fname = NULL;
+	int format = CHAIN_8BIT;
 
 	// first argument is program name
 	argv++, argc--;
@@ -53,7 +70,7 @@ int main( int argc, char* argv[] ){
 		ShowUsage();
 	}
 
-	// parse arguments
+	// parse arguments into the chain of operations, then run it
 	while (argc > 0)
 	{
 		if (**argv == '-')
@@ -61,17 +78,22 @@ int main( int argc, char* argv[] ){
 			if (!strcmp(*argv, "-input"))
 			{
 				CheckOption(*argv, argc, 2);
-				if (img != NULL)
-					delete img;
-				img = new Image(argv[1]);
+
+				Operation op(OP_INPUT);
+				op.fname = argv[1];
+				chain.push_back(op);
+				have_input = true;
 				argv += 2, argc -= 2;
 			}
 
 			else if (!strcmp(*argv, "-output"))
 			{
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
-				img->Write(argv[1]);
+				if (!have_input) ShowUsage();
+
+				Operation op(OP_OUTPUT);
+				op.fname = argv[1];
+				chain.push_back(op);
 				did_output = true;
 				argv += 2, argc -= 2;
 			}
@@ -80,10 +102,10 @@ int main( int argc, char* argv[] ){
 			{
 				double factor;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				factor = atof(argv[1]);
-				img->AddNoise(factor);
+				chain.push_back(Operation(OP_NOISE, factor));
 				argv += 2, argc -= 2;
 			}
 
@@ -91,10 +113,10 @@ int main( int argc, char* argv[] ){
 			{
 				double factor;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				factor = atof(argv[1]);
-				img->Brighten(factor);
+				chain.push_back(Operation(OP_BRIGHTNESS, factor));
 				argv += 2, argc -=2;
 			}
 
@@ -102,10 +124,10 @@ int main( int argc, char* argv[] ){
 			{
 				double factor;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				factor = atof(argv[1]);
-				img->ChangeContrast(factor);
+				chain.push_back(Operation(OP_CONTRAST, factor));
 				argv += 2, argc -= 2;
 			}
 
@@ -113,10 +135,10 @@ int main( int argc, char* argv[] ){
 			{
 				double factor;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				factor = atof(argv[1]);
-				img->ChangeSaturation(factor);
+				chain.push_back(Operation(OP_SATURATION, factor));
 				argv += 2, argc -= 2;
 			}
 
@@ -124,17 +146,14 @@ int main( int argc, char* argv[] ){
 			{
 				int x, y, w, h;
 				CheckOption(*argv, argc, 5);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				x = atoi(argv[1]);
 				y = atoi(argv[2]);
 				w = atoi(argv[3]);
 				h = atoi(argv[4]);
 
-				Image *dst = img->Crop(x, y, w, h);
-				delete img;
-				img = dst;
-
+				chain.push_back(Operation(OP_CROP, x, y, w, h));
 				argv += 5, argc -= 5;
 			}
 
@@ -142,10 +161,10 @@ int main( int argc, char* argv[] ){
 			{
 				int channel;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				channel = atoi(argv[1]);
-				img->ExtractChannel(channel);
+				chain.push_back(Operation(OP_EXTRACT_CHANNEL, channel));
 				argv += 2, argc -= 2;
 			}
 
@@ -153,10 +172,10 @@ int main( int argc, char* argv[] ){
 			{
 				int nbits;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				nbits = atoi(argv[1]);
-				img->Quantize(nbits);
+				chain.push_back(Operation(OP_QUANTIZE, nbits));
 				argv += 2, argc -= 2;
 			}
 
@@ -164,10 +183,10 @@ int main( int argc, char* argv[] ){
 			{
 				int nbits;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				nbits = atoi(argv[1]);
-				img->RandomDither(nbits);
+				chain.push_back(Operation(OP_RANDOM_DITHER, nbits));
 				argv += 2, argc -= 2;
 			}
 
@@ -175,39 +194,117 @@ int main( int argc, char* argv[] ){
 			{
 				int n;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				n = atoi(argv[1]);
-				img->Blur(n);
+
+				// sigma is optional - only take the next argument if it isn't another option
+				if (argc > 2 && *argv[2] != '-')
+				{
+					chain.push_back(Operation(OP_BLUR, n, atof(argv[2])));
+					argv += 3, argc -= 3;
+				}
+				else
+				{
+					chain.push_back(Operation(OP_BLUR, n));
+					argv += 2, argc -= 2;
+				}
+			}
+			else if (!strcmp(*argv, "-boxblur"))
+			{
+				int radius;
+				CheckOption(*argv, argc, 2);
+				if (!have_input) ShowUsage();
+
+				radius = atoi(argv[1]);
+
+				// the number of passes is optional too
+				if (argc > 2 && *argv[2] != '-')
+				{
+					chain.push_back(Operation(OP_BOX_BLUR, radius, atoi(argv[2])));
+					argv += 3, argc -= 3;
+				}
+				else
+				{
+					chain.push_back(Operation(OP_BOX_BLUR, radius, 1));
+					argv += 2, argc -= 2;
+				}
+			}
+
+			else if (!strcmp(*argv, "-fastblur"))
+			{
+				double sigma;
+				CheckOption(*argv, argc, 2);
+				if (!have_input) ShowUsage();
+
+				sigma = atof(argv[1]);
+				chain.push_back(Operation(OP_FAST_BLUR, sigma));
 				argv += 2, argc -= 2;
 			}
+
 			else if (!strcmp(*argv, "-sharpen"))
 			{
 				int n;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				n = atoi(argv[1]);
-				img->Sharpen(n);
+				chain.push_back(Operation(OP_SHARPEN, n));
 				argv += 2, argc -= 2;
 			}
 
 			else if (!strcmp(*argv, "-edgeDetect"))
 			{
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
-				img->EdgeDetect();
+				chain.push_back(Operation(OP_EDGE_DETECT));
 				argv++, argc--;
 			}
 
+			else if (!strcmp(*argv, "-histogram"))
+			{
+				CheckOption(*argv, argc, 2);
+				if (!have_input) ShowUsage();
+
+				Operation op(OP_HISTOGRAM);
+				op.fname = argv[1];
+				chain.push_back(op);
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-equalize"))
+			{
+				if (!have_input) ShowUsage();
+
+				chain.push_back(Operation(OP_EQUALIZE));
+				argv++, argc--;
+			}
+
+			else if (!strcmp(*argv, "-autolevels"))
+			{
+				if (!have_input) ShowUsage();
+
+				// the percentage of pixels ignored at each end is optional
+				if (argc > 1 && *argv[1] != '-')
+				{
+					chain.push_back(Operation(OP_AUTOLEVELS, atof(argv[1]) / 100));
+					argv += 2, argc -= 2;
+				}
+				else
+				{
+					chain.push_back(Operation(OP_AUTOLEVELS, 0.005));
+					argv++, argc--;
+				}
+			}
+
 			else if (!strcmp(*argv, "-orderedDither"))
 			{
 				int nbits;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				nbits = atoi(argv[1]);
-				img->OrderedDither(nbits);
+				chain.push_back(Operation(OP_ORDERED_DITHER, nbits));
 				argv += 2, argc -= 2;
 			}
 
@@ -215,59 +312,132 @@ int main( int argc, char* argv[] ){
 			{
 				int nbits;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				nbits = atoi(argv[1]);
-				img->FloydSteinbergDither(nbits);
+				chain.push_back(Operation(OP_FLOYD_STEINBERG_DITHER, nbits));
 				argv += 2, argc -= 2;
 			}
 
 			else if (!strcmp(*argv, "-scale"))
 			{
 				CheckOption(*argv, argc, 3);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				double sx = atof(argv[1]);
 				double sy = atof(argv[2]);
 
-				Image *dst = img->Scale(sx, sy);
-				delete img;
-
-				img = dst;
-				argv += 3, argc -= 3;
+				// filtering instead of sampling is optional
+				if (argc > 3 && *argv[3] != '-')
+				{
+					static const char *filters[IMAGE_N_FILTERS] = { "none", "box", "triangle", "catmullrom", "mitchell", "lanczos3" };
+					int filter = 0;
+					while (filter < IMAGE_N_FILTERS && strcmp(argv[3], filters[filter]))
+						filter++;
+
+					if (filter == IMAGE_N_FILTERS)
+					{
+						fprintf(stderr, "Unknown filter for -scale: %s\n", argv[3]);
+						ShowUsage();
+					}
+
+					chain.push_back(Operation(OP_SCALE, sx, sy, filter));
+					argv += 4, argc -= 4;
+				}
+				else
+				{
+					chain.push_back(Operation(OP_SCALE, sx, sy));
+					argv += 3, argc -= 3;
+				}
 			}
 
 			else if (!strcmp(*argv, "-rotate"))
 			{
 				double angle;
-				Image *dst;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				angle = atof(argv[1]);
-				dst = img->Rotate(angle);
-				delete img;
-				img = dst;
-				dst = NULL;
+				chain.push_back(Operation(OP_ROTATE, angle));
 				argv += 2, argc -= 2;
 			}
 
+			else if (!strcmp(*argv, "-affine"))
+			{
+				CheckOption(*argv, argc, 7);
+				if (!have_input) ShowUsage();
+
+				chain.push_back(Operation(OP_AFFINE, atof(argv[1]), atof(argv[2]), atof(argv[3]),
+				                          atof(argv[4]), atof(argv[5]), atof(argv[6])));
+				argv += 7, argc -= 7;
+			}
+
 			else if (!strcmp(*argv, "-fun"))
 			{
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
-				img->Fun();
+				chain.push_back(Operation(OP_FUN));
 				argv++, argc--;
 			}
 
 			else if (!strcmp(*argv, "-sampling"))
 			{
-				if (img == NULL) ShowUsage();
+				if (!have_input) ShowUsage();
 
 				int method;
 				CheckOption(*argv, argc, 2);
 				method = atoi(argv[1]);
-				img->SetSamplingMethod(method);
+				chain.push_back(Operation(OP_SAMPLING, method));
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-stream"))
+			{
+				CheckOption(*argv, argc, 2);
+
+				stream_rows = atoi(argv[1]);
+				if (stream_rows <= 0) ShowUsage();
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-batch"))
+			{
+				CheckOption(*argv, argc, 2);
+
+				// the inputs come from the manifest instead of -input
+				batch_manifest = argv[1];
+				have_input = true;
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-jobs"))
+			{
+				CheckOption(*argv, argc, 2);
+
+				batch_jobs = atoi(argv[1]);
+				if (batch_jobs <= 0) ShowUsage();
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-profile"))
+			{
+				CheckOption(*argv, argc, 2);
+
+				profile_fname = argv[1];
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-float"))
+			{
+				format = CHAIN_FLOAT;
+				argv++, argc--;
+			}
+
+			else if (!strcmp(*argv, "-threads"))
+			{
+				CheckOption(*argv, argc, 2);
+
+				SetThreadCount(atoi(argv[1]));
 				argv += 2, argc -= 2;
 			}
 
@@ -284,12 +454,62 @@ int main( int argc, char* argv[] ){
 		}
 	}
 
+	if (profile_fname != NULL && (batch_manifest != NULL || stream_rows > 0))
+	{
+		fprintf(stderr, "image: -profile can't be used with -batch or -stream\n");
+		ShowUsage();
+	}
+
+	// batch mode runs the chain (with no -input or -output of its own) on every file in the manifest
+	if (batch_manifest != NULL)
+	{
+		bool batchable = stream_rows == 0;
+		for (size_t i = 0; batchable && i < chain.size(); i++)
+			batchable = chain[i].type != OP_INPUT && chain[i].type != OP_OUTPUT;
+
+		if (!batchable)
+		{
+			fprintf(stderr, "image: -batch takes the input and output files from the manifest, and can't be used\n"
+			                "with -input, -output or -stream\n");
+			ShowUsage();
+		}
+
+		int failed = RunBatch(batch_manifest, chain, batch_jobs > 0 ? batch_jobs : ThreadCount(), format);
+		return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	// streaming runs the chain between the one input and the one output a band of rows at a time
+	if (stream_rows > 0)
+	{
+		bool streamable = chain.size() >= 2 && chain.front().type == OP_INPUT && chain.back().type == OP_OUTPUT;
+		for (size_t i = 1; streamable && i + 1 < chain.size(); i++)
+			streamable = IsStreamOperation(chain[i].type);
+
+		if (!streamable)
+		{
+			fprintf(stderr, "image: -stream needs one -input, then only -brightness, -saturation, -extractChannel,\n"
+			                "-quantize, -blur, -boxblur, -fastblur, -sharpen or -edgeDetect, then one -output\n");
+			ShowUsage();
+		}
+
+		StreamChain(chain.front().fname, chain.back().fname, Chain(chain.begin() + 1, chain.end() - 1), stream_rows, format);
+		return EXIT_SUCCESS;
+	}
+
+	ChainProfile profile;
+	Image img;
+	RunChain(&img, chain, profile_fname != NULL ? &profile : NULL, format);
+
+	if (profile_fname != NULL && !profile.Write(profile_fname))
+	{
+		fprintf(stderr, "image: can't write profile: %s\n", profile_fname);
+	}
+
 	if (!did_output)
 	{
 		fprintf( stderr, "Warning, you didn't tell me to output anything.  I hope that's OK.\n" );
 	}
 
-	delete img;
 	return EXIT_SUCCESS;
 }
 
@@ -309,20 +529,33 @@ static char options[] =
 "-extractChannel <channel no>\n"
 "-quantize <nbits>\n"
 "-randomDither <nbits>\n"
-"-blur <maskSize>\n"
+"-blur <maskSize> [sigma]\n"
+"-boxblur <radius> [passes]\n"
+"-fastblur <sigma>\n"
 "-sharpen <maskSize>\n"
 "-edgeDetect\n"
+"-histogram <file.csv>\n"
+"-equalize\n"
+"-autolevels [clip percent]\n"
 "-orderedDither <nbits>\n"
 "-FloydSteinbergDither <nbits>\n"
-"-scale <sx> <sy>\n"
+"-scale <sx> <sy> [box|triangle|catmullrom|mitchell|lanczos3]\n"
 "-rotate <angle>\n"
+"-affine <a> <b> <c> <d> <e> <f>\n"
 "-fun\n"
 "-sampling <method no>\n"
+"-threads <n>\n"
+"-stream <band rows>\n"
+"-batch <manifest>\n"
+"-jobs <images in flight>\n"
+"-profile <file.json>\n"
+"-float\n"
 ;
 
 static void ShowUsage(void)
 {
 	fprintf(stderr, "Usage: image -input <filename> [-option [arg ...] ...] -output <filename>\n");
+	fprintf(stderr, "Usage: image -batch <manifest> [-jobs <n>] [-option [arg ...] ...]\n");
 	fprintf(stderr, "%s", options);
 	exit(EXIT_FAILURE);
 }
@@ -339,4 +572,94 @@ static void CheckOption(char *option, int argc, int minargc)
 		fprintf(stderr, "Too few arguments for %s\n", option);
 		ShowUsage();
 	}
-}
\ No newline at end of file
+}
+
+
+/**
+ * RunBatch - runs the chain on every input/output pair in the manifest, jobs images at a time.
+ * An input that can't be read gets an error row and is skipped; returns how many were.
+ **/
+static double Seconds(void)
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int RunBatch(const char *manifest, const Chain& chain, int jobs, int format)
+{
+	FILE *file = fopen(manifest, "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "image: can't open manifest: %s\n", manifest);
+		exit(EXIT_FAILURE);
+	}
+
+	// one "input output" pair per line; blank lines and lines starting with # are skipped
+	vector<string> inputs, outputs;
+	char line[4096], input[2048], output[2048];
+	while (fgets(line, sizeof(line), file))
+	{
+		if (sscanf(line, "%2047s %2047s", input, output) == 2 && input[0] != '#')
+		{
+			inputs.push_back(input);
+			outputs.push_back(output);
+		}
+		else if (sscanf(line, "%2047s", input) == 1 && input[0] != '#')
+		{
+			fprintf(stderr, "image: manifest line has no output file: %s", line);
+			exit(EXIT_FAILURE);
+		}
+	}
+	fclose(file);
+
+	int count = (int) inputs.size();
+	vector<double> megapixels(count);
+	atomic<int> failed(0);
+
+	printf("input,output,width,height,ms,mpix_per_s\n");
+	double start = Seconds();
+
+	// each image runs its whole chain on one thread, so with more than one in flight the
+	// filters don't split their rows up any further
+	ParallelTasks(count, jobs, [&](int i) {
+		double t0 = Seconds();
+
+		int width, height;
+		{
+			Image img;
+			if (!img.Load(&inputs[i][0]))
+			{
+				fprintf(stderr, "image: can't load input: %s\n", inputs[i].c_str());
+				printf("%s,%s,error,,,\n", inputs[i].c_str(), outputs[i].c_str());
+				failed++;
+				return;
+			}
+			width = img.Width(), height = img.Height();
+			megapixels[i] = img.NumPixels() / 1e6;
+
+			RunChain(&img, chain, NULL, format);
+			img.Write(&outputs[i][0]);
+		}
+
+		// letting go of the image made its pixels this thread's spare; the pool's limit should cover them too
+		ScratchTrim();
+
+		double elapsed = Seconds() - t0;
+		printf("%s,%s,%d,%d,%.2f,%.2f\n", inputs[i].c_str(), outputs[i].c_str(), width, height,
+		       elapsed * 1000.0, megapixels[i] / elapsed);
+	});
+
+	double elapsed = Seconds() - start;
+	double total = 0.0;
+	for (int i = 0; i < count; i++)
+		total += megapixels[i];
+
+	fprintf(stderr, "%d images, %.1f megapixels in %.2f s with %d in flight: %.2f images/s, %.2f MP/s\n",
+	        count - failed, total, elapsed, jobs, (count - failed) / elapsed, total / elapsed);
+	if (failed > 0)
+		fprintf(stderr, "%d images couldn't be loaded\n", (int) failed);
+
+	BufferPoolStats pool = PoolStats();
+	fprintf(stderr, "buffer pool: %lld hits, %lld misses, %.1f MB held\n",
+	        pool.hits, pool.misses, pool.bytesHeld / 1048576.0);
+	return failed;
+}
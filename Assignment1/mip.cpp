@@ -0,0 +1,113 @@
+//
+//  mip.cpp
+//  Assignment1
+//
+
+#include "mip.h"
+#include "image.h"
+#include "parallel.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+MipPyramid::MipPyramid (const Image& img) : base(img) {
+    levels = 1;
+    for (int w = img.Width(), h = img.Height(); w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2) {
+        levels++;
+    }
+}
+
+
+MipPyramid::~MipPyramid () {
+    for (size_t i = 0; i < built.size(); i++) {
+        delete built[i];
+    }
+}
+
+
+const Image& MipPyramid::Level (int k) {
+    assert(k >= 0 && k < levels);
+    
+    while ((int) built.size() < k) {
+        const Image& src = built.empty() ? base : *built.back();
+        Image *half = new Image((src.Width() + 1) / 2, (src.Height() + 1) / 2);
+        HalveImage(src, *half);
+        built.push_back(half);
+    }
+    return k == 0 ? base : *built[k - 1];
+}
+
+
+void HalveImage (const Image& src, Image& dst) {
+    assert(dst.Width() == (src.Width() + 1) / 2 && dst.Height() == (src.Height() + 1) / 2);
+    int full = src.Width() / 2;     // output pixels with two source columns under them
+    
+    ParallelFor(0, dst.Height(), [&](int j0, int j1) {
+        for (int j = j0; j < j1; j++) {
+            const Pixel *top = src.Row(2 * j);
+            const Pixel *bottom = src.Row(min(2 * j + 1, src.Height() - 1));
+            Pixel *row = dst.Row(j);
+            
+            HalveSpan(top, bottom, row, full);
+            
+            if (full < dst.Width()) {
+                // the odd last column, paired with itself
+                Pixel last[2] = { top[2 * full], top[2 * full] };
+                Pixel lastBottom[2] = { bottom[2 * full], bottom[2 * full] };
+                HalveSpan(last, lastBottom, row + full, 1);
+            }
+        }
+    });
+}
+
+
+#if defined(__SSE2__)
+
+// 2 output pixels at a time.  The rows are added in 16 bit lanes, then each pixel is added to its
+// neighbour by adding the sums to themselves shifted down a pixel, and the even pixels are kept
+void HalveSpan (const Pixel *top, const Pixel *bottom, Pixel *dst, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(2);
+    int i = 0;
+    
+    for (; i + 2 <= count; i += 2) {
+        __m128i t = _mm_loadu_si128((const __m128i*) (top + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (bottom + 2 * i));
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(t, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(b, zero));
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+        __m128i sums = _mm_unpacklo_epi64(lo, hi);
+        sums = _mm_srli_epi16(_mm_add_epi16(sums, round), 2);
+        _mm_storel_epi64((__m128i*) (dst + i), _mm_packus_epi16(sums, sums));
+    }
+    
+    for (; i < count; i++) {
+        const Pixel *t = top + 2 * i, *b = bottom + 2 * i;
+        dst[i] = Pixel((t[0].r + t[1].r + b[0].r + b[1].r + 2) >> 2,
+                       (t[0].g + t[1].g + b[0].g + b[1].g + 2) >> 2,
+                       (t[0].b + t[1].b + b[0].b + b[1].b + 2) >> 2,
+                       (t[0].a + t[1].a + b[0].a + b[1].a + 2) >> 2);
+    }
+}
+
+#else
+
+void HalveSpan (const Pixel *top, const Pixel *bottom, Pixel *dst, int count) {
+    for (int i = 0; i < count; i++) {
+        const Pixel *t = top + 2 * i, *b = bottom + 2 * i;
+        dst[i] = Pixel((t[0].r + t[1].r + b[0].r + b[1].r + 2) >> 2,
+                       (t[0].g + t[1].g + b[0].g + b[1].g + 2) >> 2,
+                       (t[0].b + t[1].b + b[0].b + b[1].b + 2) >> 2,
+                       (t[0].a + t[1].a + b[0].a + b[1].a + 2) >> 2);
+    }
+}
+
+#endif
@@ -0,0 +1,51 @@
+//Mip.h
+//
+//Mip pyramid of an image
+//
+//  Level 0 is the image itself, and each level after that is the one
+//  before it averaged down 2x2, to 1x1.  Shrinking a lot by sampling reads
+//  the level closest to the result's size instead of the full image, so
+//  the samples don't skip over (and alias) most of the detail, and the cost
+//  goes with the output size instead of the input's.
+
+#ifndef MIP_INCLUDED
+#define MIP_INCLUDED
+
+#include <vector>
+#include "pixel.h"
+
+class Image;
+
+class MipPyramid
+{
+public:
+    // A pyramid over img, which has to outlive it; no levels are built until they're asked for
+    MipPyramid (const Image& img);
+    ~MipPyramid ();
+
+    // Number of levels, down to 1x1 (and including level 0)
+    int Levels () const { return levels; }
+
+    // Level k, built (along with any before it) the first time it's asked for
+    const Image& Level (int k);
+
+private:
+    // no copying
+    MipPyramid (const MipPyramid&);
+    void operator= (const MipPyramid&);
+
+    const Image& base;
+    int levels;
+    std::vector<Image*> built;      // levels 1 and up, as far as they've been built
+};
+
+/**
+ * dst = src averaged down 2x2, rounded to nearest.  dst is (w + 1) / 2 by
+ * (h + 1) / 2; an odd last row or column is averaged with itself.
+ **/
+void HalveImage (const Image& src, Image& dst);
+
+// dst[i] = the average of top[2i], top[2i + 1], bottom[2i] and bottom[2i + 1], for count output pixels
+void HalveSpan (const Pixel *top, const Pixel *bottom, Pixel *dst, int count);
+
+#endif
@@ -0,0 +1,225 @@
+//
+//  parallel.cpp
+//  Assignment1
+//
+
+#include "parallel.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+
+/**
+ * Pool
+ **/
+namespace {
+
+class Pool
+{
+public:
+    Pool () : body(NULL), generation(0), quit(false) { Start(DefaultThreadCount()); }
+    ~Pool () { Stop(); }
+
+    // Number of threads including the one calling Run
+    int Threads () const { return (int) workers.size() + 1; }
+
+    void Resize (int n) {
+        lock_guard<mutex> run(running);
+        Stop();
+        Start(n);
+    }
+
+    // Returns false without doing anything if another Run is in progress
+    bool TryRun (int begin, int end, const function<void (int, int)>& body_);
+
+private:
+    static int DefaultThreadCount ();
+
+    void Start (int n);
+    void Stop ();
+    void Work (unsigned seen);
+
+    // Runs bands until there are none left to hand out; expects lock to be held
+    void RunBands (unique_lock<mutex>& held);
+
+    vector<thread> workers;
+
+    mutex running;                  // held for the whole of a Run
+    mutex lock;                     // guards everything below
+    condition_variable wake, done;
+
+    const function<void (int, int)> *body;
+    int begin, end, bandSize;
+    int nextBand, numBands, pendingBands;
+    unsigned generation;            // bumped for every Run so sleeping workers know there's work
+    bool quit;
+};
+
+// set while a thread is inside a band so nested calls don't wait on themselves
+thread_local bool inBand = false;
+
+
+int Pool::DefaultThreadCount () {
+    const char *env = getenv("IMAGE_THREADS");
+    int n = env != NULL ? atoi(env) : 0;
+
+    if (n <= 0) {
+        n = thread::hardware_concurrency();
+    }
+    return max(n, 1);
+}
+
+
+void Pool::Start (int n) {
+    if (n <= 0) {
+        n = DefaultThreadCount();
+    }
+
+    quit = false;
+    for (int i = 1; i < n; i++) {
+        workers.push_back(thread(&Pool::Work, this, generation));
+    }
+}
+
+
+void Pool::Stop () {
+    {
+        lock_guard<mutex> held(lock);
+        quit = true;
+    }
+    wake.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    workers.clear();
+}
+
+
+void Pool::RunBands (unique_lock<mutex>& held) {
+    while (nextBand < numBands) {
+        int band = nextBand++;
+        int bandBegin = begin + band * bandSize;
+        int bandEnd = min(bandBegin + bandSize, end);
+
+        held.unlock();
+        inBand = true;
+        (*body)(bandBegin, bandEnd);
+        inBand = false;
+        held.lock();
+
+        if (--pendingBands == 0) {
+            done.notify_all();
+        }
+    }
+}
+
+
+void Pool::Work (unsigned seen) {
+    unique_lock<mutex> held(lock);
+
+    while (true) {
+        wake.wait(held, [&] { return quit || generation != seen; });
+        if (quit) {
+            return;
+        }
+
+        seen = generation;
+        RunBands(held);
+    }
+}
+
+
+bool Pool::TryRun (int begin_, int end_, const function<void (int, int)>& body_) {
+    unique_lock<mutex> run(running, try_to_lock);
+    if (!run.owns_lock()) {
+        return false;
+    }
+
+    unique_lock<mutex> held(lock);
+
+    // a few bands per thread so a slow band doesn't hold everyone else up
+    int rows = end_ - begin_;
+    int bands = min(rows, Threads() * 4);
+
+    body = &body_;
+    begin = begin_;
+    end = end_;
+    bandSize = (rows + bands - 1) / bands;
+    numBands = (rows + bandSize - 1) / bandSize;
+    nextBand = 0;
+    pendingBands = numBands;
+    generation++;
+    wake.notify_all();
+
+    // the calling thread works too, then waits for whatever bands are still running elsewhere
+    RunBands(held);
+    done.wait(held, [&] { return pendingBands == 0; });
+    body = NULL;
+    return true;
+}
+
+
+Pool& ThePool () {
+    static Pool pool;
+    return pool;
+}
+
+}
+
+
+void SetThreadCount(int n) {
+    ThePool().Resize(n);
+}
+
+
+int ThreadCount() {
+    return ThePool().Threads();
+}
+
+
+void ParallelFor(int begin, int end, const function<void (int, int)>& body) {
+    if (end <= begin) {
+        return;
+    }
+
+    if (inBand || ThePool().Threads() == 1 || !ThePool().TryRun(begin, end, body)) {
+        body(begin, end);
+    }
+}
+
+
+void ParallelTasks(int count, int n, const function<void (int)>& body) {
+    atomic<int> next(0);
+    
+    auto work = [&] {
+        inBand = true;
+        for (int i = next++; i < count; i = next++) {
+            body(i);
+        }
+        inBand = false;
+    };
+    
+    vector<thread> threads;
+    for (int t = 1; t < min(n, count); t++) {
+        threads.push_back(thread(work));
+    }
+    
+    // with only one thread there's no point hiding the pool from the tasks
+    if (threads.empty()) {
+        for (int i = 0; i < count; i++) {
+            body(i);
+        }
+    } else {
+        work();
+    }
+    
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+}
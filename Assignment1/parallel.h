@@ -0,0 +1,40 @@
+//Parallel.h
+//
+//Row band thread pool shared by the image filters
+//
+//  The pool is created once, the first time it's needed, and is reused by
+//  every filter after that.
+
+#ifndef PARALLEL_INCLUDED
+#define PARALLEL_INCLUDED
+
+#include <functional>
+
+/**
+ * Sets the number of threads the filters run on (including the calling thread).
+ * n <= 0 uses the IMAGE_THREADS environment variable if it's set, and otherwise
+ * the number of hardware threads.
+ **/
+void SetThreadCount(int n);
+
+// Returns the number of threads the filters run on.
+int ThreadCount();
+
+/**
+ * Splits the rows [begin, end) into bands and runs body(bandBegin, bandEnd) on
+ * every band using the thread pool, returning once all of them are done.
+ * A band must only write to its own rows, so the result doesn't depend on how
+ * the rows were split up.  If the pool is already busy (a nested call, or
+ * another thread's filter), the bands run serially on the calling thread.
+ **/
+void ParallelFor(int begin, int end, const std::function<void (int, int)>& body);
+
+/**
+ * Runs body(i) for every i in [0, count) on its own set of n threads, each
+ * taking the next i as soon as it's done with the last one.  Anything body
+ * calls ParallelFor on runs serially on that thread, since the tasks are
+ * already keeping every thread busy.
+ **/
+void ParallelTasks(int count, int n, const std::function<void (int)>& body);
+
+#endif
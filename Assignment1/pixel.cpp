@@ -3,6 +3,12 @@
 #include <math.h>
 #include <stdlib.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 
 /**
@@ -123,3 +129,218 @@ Pixel PixelQuant( const Pixel &p, int nbits)
 }
 
 
+/**
+ * Spans
+ **/
+
+// Largest 8.8 fixed point factor that still fits the 16 bit multipliers
+static const double SpanFactorLimit = 32767.0 / 256.0 - 1.0;
+
+// Rounds a factor to 8.8 fixed point
+static inline int FixedFactor(double f)
+{
+    return (int) floor(f * 256.0 + 0.5);
+}
+
+// Two 16 bit multipliers packed the way madd pairs them up with interleaved components
+static inline int WeightPair(int lo, int hi)
+{
+    return (int) (((uint32_t) (uint16_t) hi << 16) | (uint16_t) lo);
+}
+
+// Components as one flat array, so the vector loops don't care where pixels start and end
+static inline const uint8_t* Components(const Pixel *p) { return (const uint8_t *) p; }
+static inline uint8_t* Components(Pixel *p) { return (uint8_t *) p; }
+
+
+#if defined(__AVX2__)
+
+// 8 pixels at a time: p * (256 - T) + q * T, via madd on interleaved (p, q) and (256 - T, T) pairs
+static int LerpVector(const uint8_t *p, const uint8_t *q, uint8_t *dst, int n, int T)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i weights = _mm256_set1_epi32(WeightPair(256 - T, T));
+    const __m256i half = _mm256_set1_epi32(128);
+    int i = 0;
+    
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (q + i));
+        __m256i alo = _mm256_unpacklo_epi8(a, zero), ahi = _mm256_unpackhi_epi8(a, zero);
+        __m256i blo = _mm256_unpacklo_epi8(b, zero), bhi = _mm256_unpackhi_epi8(b, zero);
+        
+        __m256i r0 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(alo, blo), weights), half), 8);
+        __m256i r1 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(alo, blo), weights), half), 8);
+        __m256i r2 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(ahi, bhi), weights), half), 8);
+        __m256i r3 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(ahi, bhi), weights), half), 8);
+        
+        // the packs saturate, which does the clamping
+        __m256i lo = _mm256_packs_epi32(r0, r1), hi = _mm256_packs_epi32(r2, r3);
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+// 8 pixels at a time: c * F + 128, via madd on interleaved (c, 1) and (F, 128) pairs
+static int ScaleVector(const uint8_t *src, uint8_t *dst, int n, int F)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i weights = _mm256_set1_epi32(WeightPair(F, 128));
+    int i = 0;
+    
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i alo = _mm256_unpacklo_epi8(a, zero), ahi = _mm256_unpackhi_epi8(a, zero);
+        
+        __m256i r0 = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(alo, ones), weights), 8);
+        __m256i r1 = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(alo, ones), weights), 8);
+        __m256i r2 = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(ahi, ones), weights), 8);
+        __m256i r3 = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(ahi, ones), weights), 8);
+        
+        __m256i lo = _mm256_packs_epi32(r0, r1), hi = _mm256_packs_epi32(r2, r3);
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+#elif defined(__SSE2__)
+
+// 4 pixels at a time: p * (256 - T) + q * T, via madd on interleaved (p, q) and (256 - T, T) pairs
+static int LerpVector(const uint8_t *p, const uint8_t *q, uint8_t *dst, int n, int T)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_set1_epi32(WeightPair(256 - T, T));
+    const __m128i half = _mm_set1_epi32(128);
+    int i = 0;
+    
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (q + i));
+        __m128i alo = _mm_unpacklo_epi8(a, zero), ahi = _mm_unpackhi_epi8(a, zero);
+        __m128i blo = _mm_unpacklo_epi8(b, zero), bhi = _mm_unpackhi_epi8(b, zero);
+        
+        __m128i r0 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), weights), half), 8);
+        __m128i r1 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), weights), half), 8);
+        __m128i r2 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), weights), half), 8);
+        __m128i r3 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), weights), half), 8);
+        
+        // the packs saturate, which does the clamping
+        __m128i lo = _mm_packs_epi32(r0, r1), hi = _mm_packs_epi32(r2, r3);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+// 4 pixels at a time: c * F + 128, via madd on interleaved (c, 1) and (F, 128) pairs
+static int ScaleVector(const uint8_t *src, uint8_t *dst, int n, int F)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i weights = _mm_set1_epi32(WeightPair(F, 128));
+    int i = 0;
+    
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i alo = _mm_unpacklo_epi8(a, zero), ahi = _mm_unpackhi_epi8(a, zero);
+        
+        __m128i r0 = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(alo, ones), weights), 8);
+        __m128i r1 = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(alo, ones), weights), 8);
+        __m128i r2 = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(ahi, ones), weights), 8);
+        __m128i r3 = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(ahi, ones), weights), 8);
+        
+        __m128i lo = _mm_packs_epi32(r0, r1), hi = _mm_packs_epi32(r2, r3);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+#else
+
+// no vector unit to use - the scalar loops below do all of it
+static int LerpVector(const uint8_t *, const uint8_t *, uint8_t *, int, int) { return 0; }
+static int ScaleVector(const uint8_t *, uint8_t *, int, int) { return 0; }
+
+#endif
+
+
+
+#if defined(__SSE2__)
+
+// 16 pixels at a time.  Masking out every other byte leaves (r, b) and (g, a) as 16 bit pairs,
+// which madd weights and adds up in one go
+static int LuminanceVector(const Pixel *src, Component *dst, int count)
+{
+    const __m128i mask = _mm_set1_epi32(0x00ff00ff);
+    const __m128i redBlue = _mm_set1_epi32(WeightPair(76, 29));
+    const __m128i greenAlpha = _mm_set1_epi32(WeightPair(150, 0));
+    int i = 0;
+    
+    for (; i + 16 <= count; i += 16) {
+        __m128i l[4];
+        for (int k = 0; k < 4; k++) {
+            __m128i p = _mm_loadu_si128((const __m128i *) (src + i + 4 * k));
+            __m128i rb = _mm_madd_epi16(_mm_and_si128(p, mask), redBlue);
+            __m128i ga = _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(p, 8), mask), greenAlpha);
+            l[k] = _mm_srli_epi32(_mm_add_epi32(rb, ga), 8);
+        }
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(_mm_packs_epi32(l[0], l[1]), _mm_packs_epi32(l[2], l[3])));
+    }
+    return i;
+}
+
+#else
+
+static int LuminanceVector(const Pixel *, Component *, int) { return 0; }
+
+#endif
+
+
+void LerpSpan (const Pixel *p, const Pixel *q, Pixel *dst, int count, double t)
+{
+    // too far out for the fixed point weights
+    if (fabs(t) > SpanFactorLimit) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = PixelLerp(p[i], q[i], t);
+        }
+        return;
+    }
+    
+    const uint8_t *a = Components(p), *b = Components(q);
+    uint8_t *d = Components(dst);
+    int n = count * 4;
+    int T = FixedFactor(t);
+    
+    // same fixed point math as the vector version for whatever is left over
+    for (int i = LerpVector(a, b, d, n, T); i < n; i++) {
+        d[i] = ComponentClamp((a[i] * (256 - T) + b[i] * T + 128) >> 8);
+    }
+}
+
+
+void ScaleSpan (const Pixel *src, Pixel *dst, int count, double f)
+{
+    if (fabs(f) > SpanFactorLimit) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = src[i] * f;
+        }
+        return;
+    }
+    
+    const uint8_t *a = Components(src);
+    uint8_t *d = Components(dst);
+    int n = count * 4;
+    int F = FixedFactor(f);
+    
+    for (int i = ScaleVector(a, d, n, F); i < n; i++) {
+        d[i] = ComponentClamp((a[i] * F + 128) >> 8);
+    }
+}
+
+
+void LuminanceSpan (const Pixel *src, Component *dst, int count)
+{
+    for (int i = LuminanceVector(src, dst, count); i < count; i++) {
+        dst[i] = (src[i].r * 76 + src[i].g * 150 + src[i].b * 29) >> 8;
+    }
+}
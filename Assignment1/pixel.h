@@ -75,4 +75,22 @@ Pixel PixelLerp (const Pixel& p, const Pixel& q, double t);
 
 Pixel PixelQuant(const Pixel &p, int nbits);
 
+
+
+/**
+ * Span versions of the pixel operations, for running on whole rows at once.
+ * They work in 8.8 fixed point with saturating integer math (using SSE2 or
+ * AVX2 when the compiler targets them), so they can differ from the per-pixel
+ * versions by 1.  dst may be the same as a source.
+ **/
+
+// dst[i] = PixelLerp(p[i], q[i], t)
+void LerpSpan (const Pixel *p, const Pixel *q, Pixel *dst, int count, double t);
+
+// dst[i] = src[i] * f
+void ScaleSpan (const Pixel *src, Pixel *dst, int count, double f);
+
+// dst[i] = src[i].Luminance() (exactly)
+void LuminanceSpan (const Pixel *src, Component *dst, int count);
+
 #endif
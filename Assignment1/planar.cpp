@@ -0,0 +1,300 @@
+//
+//  planar.cpp
+//  Assignment1
+//
+
+#include "planar.h"
+#include "image.h"
+#include "parallel.h"
+#include "bufferpool.h"
+#include "scratch.h"
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/**
+ * Conversions
+ **/
+#if defined(__SSE2__)
+
+// 16 pixels at a time.  Each channel is shifted down to the low byte of its 32 bit lanes, masked,
+// and packed down to bytes with saturating packs (which never saturate, since every value is <= 255)
+void DeinterleaveSpan (const Pixel *src, Component *r, Component *g, Component *b, Component *a, int count) {
+    const __m128i low = _mm_set1_epi32(0xff);
+    int i = 0;
+    
+    for (; i + 16 <= count; i += 16) {
+        __m128i p0 = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i*) (src + i + 4));
+        __m128i p2 = _mm_loadu_si128((const __m128i*) (src + i + 8));
+        __m128i p3 = _mm_loadu_si128((const __m128i*) (src + i + 12));
+        
+        Component *dst[4] = { r, g, b, a };
+        for (int c = 0; c < 4; c++) {
+            __m128i c0 = _mm_and_si128(_mm_srli_epi32(p0, 8 * c), low);
+            __m128i c1 = _mm_and_si128(_mm_srli_epi32(p1, 8 * c), low);
+            __m128i c2 = _mm_and_si128(_mm_srli_epi32(p2, 8 * c), low);
+            __m128i c3 = _mm_and_si128(_mm_srli_epi32(p3, 8 * c), low);
+            __m128i packed = _mm_packus_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3));
+            _mm_storeu_si128((__m128i*) (dst[c] + i), packed);
+        }
+    }
+    
+    for (; i < count; i++) {
+        r[i] = src[i].r;
+        g[i] = src[i].g;
+        b[i] = src[i].b;
+        a[i] = src[i].a;
+    }
+}
+
+void InterleaveSpan (const Component *r, const Component *g, const Component *b, const Component *a, Pixel *dst, int count) {
+    int i = 0;
+    
+    for (; i + 16 <= count; i += 16) {
+        __m128i vr = _mm_loadu_si128((const __m128i*) (r + i));
+        __m128i vg = _mm_loadu_si128((const __m128i*) (g + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*) (b + i));
+        __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+        
+        // rgrg... and baba..., then those pairs interleaved again give rgba
+        __m128i rgLow = _mm_unpacklo_epi8(vr, vg), rgHigh = _mm_unpackhi_epi8(vr, vg);
+        __m128i baLow = _mm_unpacklo_epi8(vb, va), baHigh = _mm_unpackhi_epi8(vb, va);
+        
+        _mm_storeu_si128((__m128i*) (dst + i),      _mm_unpacklo_epi16(rgLow, baLow));
+        _mm_storeu_si128((__m128i*) (dst + i + 4),  _mm_unpackhi_epi16(rgLow, baLow));
+        _mm_storeu_si128((__m128i*) (dst + i + 8),  _mm_unpacklo_epi16(rgHigh, baHigh));
+        _mm_storeu_si128((__m128i*) (dst + i + 12), _mm_unpackhi_epi16(rgHigh, baHigh));
+    }
+    
+    for (; i < count; i++) {
+        dst[i] = Pixel(r[i], g[i], b[i], a[i]);
+    }
+}
+
+#else
+
+void DeinterleaveSpan (const Pixel *src, Component *r, Component *g, Component *b, Component *a, int count) {
+    for (int i = 0; i < count; i++) {
+        r[i] = src[i].r;
+        g[i] = src[i].g;
+        b[i] = src[i].b;
+        a[i] = src[i].a;
+    }
+}
+
+void InterleaveSpan (const Component *r, const Component *g, const Component *b, const Component *a, Pixel *dst, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = Pixel(r[i], g[i], b[i], a[i]);
+    }
+}
+
+#endif
+
+
+/**
+ * PlanarImage
+ **/
+PlanarImage::PlanarImage (int width_, int height_, int pad_, int scratchSlot) {
+    assert(width_ > 0 && height_ > 0 && pad_ >= 0);
+    
+    width = width_;
+    height = height_;
+    pad = pad_;
+    
+    lead = (pad + 15) / 16 * 16;
+    stride = (lead + width + pad + 15) / 16 * 16;
+    planeSize = (size_t) stride * height;
+    
+    scratch = scratchSlot >= 0;
+    if (scratch) {
+        planes = Scratch<Component>(scratchSlot, planeSize * IMAGE_N_CHANNELS);
+    } else {
+        planes = (Component*) PoolAllocate(planeSize * IMAGE_N_CHANNELS);
+    }
+}
+
+
+PlanarImage::~PlanarImage () {
+    if (!scratch) {
+        PoolRelease(planes, planeSize * IMAGE_N_CHANNELS);
+    }
+}
+
+
+void PlanarImage::Load (const Image& img, int y0, int y1) {
+    assert(img.Width() == width && img.Height() == height);
+    
+    for (int y = y0; y < y1; y++) {
+        Component *rows[IMAGE_N_CHANNELS];
+        for (int c = 0; c < IMAGE_N_CHANNELS; c++) {
+            rows[c] = Row(c, y);
+        }
+        
+        DeinterleaveSpan(img.Row(y), rows[0], rows[1], rows[2], rows[3], width);
+        
+        // extend the leftmost/rightmost pixels into the padding
+        for (int c = 0; c < IMAGE_N_CHANNELS; c++) {
+            memset(rows[c] - pad, rows[c][0], pad);
+            memset(rows[c] + width, rows[c][width - 1], pad);
+        }
+    }
+}
+
+
+void PlanarImage::Load (const Image& img) {
+    ParallelFor(0, height, [&](int y0, int y1) {
+        Load(img, y0, y1);
+    });
+}
+
+
+void PlanarImage::Store (Image& img, int y0, int y1) const {
+    assert(img.Width() == width && img.Height() == height);
+    
+    for (int y = y0; y < y1; y++) {
+        InterleaveSpan(Row(0, y), Row(1, y), Row(2, y), Row(3, y), img.Row(y), width);
+    }
+}
+
+
+/**
+ * Row kernels
+ **/
+#if defined(__AVX2__)
+
+// 8 values at a time
+static inline __m256 LoadFloats (const Component *src) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) src)));
+}
+
+static inline __m256 LoadFloats (const float *src) {
+    return _mm256_loadu_ps(src);
+}
+
+static inline __m256 MultiplyAdd (__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+template <typename T>
+static void MultiplyAdd (float *acc, const T *src, float weight, int count) {
+    __m256 w = _mm256_set1_ps(weight);
+    int i = 0;
+    
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(acc + i, MultiplyAdd(w, LoadFloats(src + i), _mm256_loadu_ps(acc + i)));
+    }
+    for (; i < count; i++) {
+        acc[i] += weight * src[i];
+    }
+}
+
+void RoundSpan (const float *src, Component *dst, int count) {
+    __m256 half = _mm256_set1_ps(0.5f);
+    int i = 0;
+    
+    for (; i + 8 <= count; i += 8) {
+        __m256i rounded = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_loadu_ps(src + i), half));
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(rounded), _mm256_extracti128_si256(rounded, 1));
+        _mm_storel_epi64((__m128i*) (dst + i), _mm_packus_epi16(words, words));
+    }
+    for (; i < count; i++) {
+        dst[i] = ComponentClamp((int) (src[i] + 0.5f));
+    }
+}
+
+#elif defined(__SSE2__)
+
+// 4 values at a time
+static inline __m128 LoadFloats (const Component *src) {
+    int bytes;
+    memcpy(&bytes, src, 4);
+    __m128i zero = _mm_setzero_si128();
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero));
+}
+
+static inline __m128 LoadFloats (const float *src) {
+    return _mm_loadu_ps(src);
+}
+
+template <typename T>
+static void MultiplyAdd (float *acc, const T *src, float weight, int count) {
+    __m128 w = _mm_set1_ps(weight);
+    int i = 0;
+    
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_mul_ps(w, LoadFloats(src + i)), _mm_loadu_ps(acc + i)));
+    }
+    for (; i < count; i++) {
+        acc[i] += weight * src[i];
+    }
+}
+
+void RoundSpan (const float *src, Component *dst, int count) {
+    __m128 half = _mm_set1_ps(0.5f);
+    int i = 0;
+    
+    for (; i + 8 <= count; i += 8) {
+        __m128i low = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(src + i), half));
+        __m128i high = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(src + i + 4), half));
+        __m128i words = _mm_packs_epi32(low, high);
+        _mm_storel_epi64((__m128i*) (dst + i), _mm_packus_epi16(words, words));
+    }
+    for (; i < count; i++) {
+        dst[i] = ComponentClamp((int) (src[i] + 0.5f));
+    }
+}
+
+#else
+
+template <typename T>
+static void MultiplyAdd (float *acc, const T *src, float weight, int count) {
+    for (int i = 0; i < count; i++) {
+        acc[i] += weight * src[i];
+    }
+}
+
+void RoundSpan (const float *src, Component *dst, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = ComponentClamp((int) (src[i] + 0.5f));
+    }
+}
+
+#endif
+
+
+void FloatSpan (const Component *src, float *dst, int count) {
+    int i = 0;
+    
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, LoadFloats(src + i));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, LoadFloats(src + i));
+    }
+#endif
+    
+    for (; i < count; i++) {
+        dst[i] = src[i];
+    }
+}
+
+
+void MultiplyAddSpan (float *acc, const Component *src, float weight, int count) {
+    MultiplyAdd(acc, src, weight, count);
+}
+
+void MultiplyAddSpan (float *acc, const float *src, float weight, int count) {
+    MultiplyAdd(acc, src, weight, count);
+}
@@ -0,0 +1,87 @@
+//Planar.h
+//
+//Planar (one array per channel) copy of an image
+//
+//  Image keeps interleaved RGBA pixels, which makes a convolution pick every
+//  channel out of every tap and carry alpha along for nothing.  A
+//  PlanarImage keeps each channel in its own plane instead, with rows that
+//  start on a 16 byte boundary and are padded on both sides with copies of
+//  the edge pixels, so a stencil filter can run down each plane with plain
+//  contiguous (vectorizable) loops and no edge checks along the row.
+
+#ifndef PLANAR_INCLUDED
+#define PLANAR_INCLUDED
+
+#include <stddef.h>
+#include "pixel.h"
+
+class Image;
+
+// Splits count pixels into separate r, g, b and a arrays
+void DeinterleaveSpan (const Pixel *src, Component *r, Component *g, Component *b, Component *a, int count);
+
+// Puts count pixels back together from separate r, g, b and a arrays
+void InterleaveSpan (const Component *r, const Component *g, const Component *b, const Component *a, Pixel *dst, int count);
+
+/**
+ * Row kernels for filters working on a plane at a time, vectorized the same
+ * way as the span kernels in pixel.h.
+ **/
+
+// acc[i] += weight * src[i] for count values
+void MultiplyAddSpan (float *acc, const Component *src, float weight, int count);
+void MultiplyAddSpan (float *acc, const float *src, float weight, int count);
+
+// dst[i] = ComponentClamp((int) (src[i] + 0.5f)) for count values
+void RoundSpan (const float *src, Component *dst, int count);
+
+// dst[i] = src[i] for count values
+void FloatSpan (const Component *src, float *dst, int count);
+
+class PlanarImage
+{
+public:
+    /**
+     * Planes for a width x height image, with pad columns of padding on each
+     * side of every row.  With a scratch slot (see Scratch.h) they're in the
+     * calling thread's scratch memory for it, instead of a buffer of their own.
+     **/
+    PlanarImage (int width, int height, int pad, int scratchSlot = -1);
+    ~PlanarImage ();
+
+    int Width  () const { return width; }
+    int Height () const { return height; }
+    int Pad    () const { return pad; }
+
+    /**
+     * Row y of a channel (IMAGE_CHANNEL_RED to IMAGE_CHANNEL_ALPHA).  Columns
+     * -Pad() to Width() + Pad() - 1 can be read; the ones outside the image are
+     * copies of the nearest edge pixel once the row has been loaded.
+     **/
+    Component* Row (int channel, int y) const {
+        return planes + channel * planeSize + (size_t) y * stride + lead;
+    }
+
+    // Copies the rows [y0, y1) of img, which has to be the same size, into the planes
+    void Load (const Image& img, int y0, int y1);
+
+    // Copies all of img, splitting the rows up on the thread pool
+    void Load (const Image& img);
+
+    // Copies the rows [y0, y1) back into img
+    void Store (Image& img, int y0, int y1) const;
+
+private:
+    // no copying
+    PlanarImage (const PlanarImage&);
+    void operator= (const PlanarImage&);
+
+    Component *planes;
+    bool scratch;       // planes belongs to the thread's scratch memory, not to the PlanarImage
+    size_t planeSize;   // bytes from one plane to the next
+    int width, height, pad;
+    int stride;         // bytes from one row to the next
+    int lead;           // bytes from the start of a row to column 0 (pad rounded up to keep column 0 aligned)
+};
+
+#endif
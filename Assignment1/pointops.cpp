@@ -0,0 +1,247 @@
+//
+//  pointops.cpp
+//  Assignment1
+//
+
+#include "pointops.h"
+#include "image.h"
+#include "parallel.h"
+#include <math.h>
+
+
+// luminance weights from Pixel::Luminance
+static const float LuminanceWeights[3] = { 76 / 256.0f, 150 / 256.0f, 29 / 256.0f };
+
+
+/**
+ * PointPipeline
+ **/
+PointPipeline::PointPipeline () {
+    Clear();
+}
+
+
+void PointPipeline::Clear () {
+    stages.clear();
+    for (int v = 0; v < 256; v++) {
+        alpha[v] = v;
+    }
+}
+
+
+PointPipeline::Stage& PointPipeline::TableStage () {
+    if (stages.empty() || stages.back().type != STAGE_TABLE) {
+        Stage stage;
+        stage.type = STAGE_TABLE;
+        for (int c = 0; c < 3; c++) {
+            for (int v = 0; v < 256; v++) {
+                stage.table[c][v] = v;
+            }
+        }
+        stages.push_back(stage);
+    }
+    return stages.back();
+}
+
+
+void PointPipeline::AddTables (const Pixel *ramp) {
+    Stage& stage = TableStage();
+    
+    for (int v = 0; v < 256; v++) {
+        stage.table[0][v] = ramp[stage.table[0][v]].r;
+        stage.table[1][v] = ramp[stage.table[1][v]].g;
+        stage.table[2][v] = ramp[stage.table[2][v]].b;
+        alpha[v] = ramp[alpha[v]].a;
+    }
+}
+
+
+// A one row image holding the 256 gray pixels (v, v, v, v), for building tables by running the Image methods themselves
+static Image* GrayRamp () {
+    Image *ramp = new Image(256, 1);
+    for (int v = 0; v < 256; v++) {
+        ramp->data.pixels[v] = Pixel(v, v, v, v);
+    }
+    return ramp;
+}
+
+
+void PointPipeline::Brighten (double factor) {
+    Image *ramp = GrayRamp();
+    ramp->Brighten(factor);
+    AddTables(ramp->data.pixels);
+    delete ramp;
+}
+
+
+void PointPipeline::Quantize (int nbits) {
+    Image *ramp = GrayRamp();
+    ramp->Quantize(nbits);
+    AddTables(ramp->data.pixels);
+    delete ramp;
+}
+
+
+void PointPipeline::ExtractChannel (int channel) {
+    Image *ramp = GrayRamp();
+    ramp->ExtractChannel(channel);
+    AddTables(ramp->data.pixels);
+    delete ramp;
+}
+
+
+void PointPipeline::ChangeContrast (double factor, Component meanLuminance) {
+    // same LerpSpan against the (mean, mean, mean, 1) pixel that Image::ChangeContrast does
+    Pixel gray[256], ramp[256];
+    for (int v = 0; v < 256; v++) {
+        gray[v] = Pixel(meanLuminance, meanLuminance, meanLuminance, 1);
+        ramp[v] = Pixel(v, v, v, v);
+    }
+    LerpSpan(gray, ramp, ramp, 256, factor);
+    AddTables(ramp);
+}
+
+
+void PointPipeline::ChangeSaturation (double factor) {
+    // what Image::ChangeSaturation's LerpSpan gives for every (luminance, component) pair -
+    // the alpha it gets from the gray pixel's 1 doesn't depend on the luminance
+    std::vector<Component> lerp(256 * 256);
+    Pixel gray[256], ramp[256];
+    
+    for (int luminance = 0; luminance < 256; luminance++) {
+        for (int c = 0; c < 256; c++) {
+            gray[c] = Pixel(luminance, luminance, luminance, 1);
+            ramp[c] = Pixel(c, c, c, c);
+        }
+        LerpSpan(gray, ramp, ramp, 256, factor);
+        
+        for (int c = 0; c < 256; c++) {
+            lerp[luminance * 256 + c] = ramp[c].r;
+        }
+    }
+    
+    for (int v = 0; v < 256; v++) {
+        alpha[v] = ramp[alpha[v]].a;
+    }
+    
+    // (1 - factor) * luminance + factor * color, as a matrix
+    float saturation[3][3];
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++) {
+            saturation[c][k] = (1.0f - factor) * LuminanceWeights[k] + (c == k ? factor : 0.0f);
+        }
+    }
+    
+    if (stages.empty() || stages.back().type == STAGE_TABLE) {
+        Stage stage;
+        stage.type = STAGE_SATURATION;
+        stage.lerp.swap(lerp);
+        for (int c = 0; c < 3; c++) {
+            for (int k = 0; k < 3; k++) {
+                stage.matrix[c][k] = saturation[c][k];
+            }
+        }
+        stages.push_back(stage);
+        return;
+    }
+    
+    // fold it into the color matrix before it
+    Stage& stage = stages.back();
+    float composed[3][3];
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++) {
+            composed[c][k] = 0.0f;
+            for (int m = 0; m < 3; m++) {
+                composed[c][k] += saturation[c][m] * stage.matrix[m][k];
+            }
+        }
+    }
+    
+    stage.type = STAGE_MATRIX;
+    stage.lerp.clear();
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++) {
+            stage.matrix[c][k] = composed[c][k];
+        }
+    }
+}
+
+
+void PointPipeline::Transform (Pixel& p) const {
+    for (size_t s = 0; s < stages.size(); s++) {
+        const Stage& stage = stages[s];
+        
+        switch (stage.type) {
+            case STAGE_TABLE:
+                p.r = stage.table[0][p.r];
+                p.g = stage.table[1][p.g];
+                p.b = stage.table[2][p.b];
+                break;
+                
+            case STAGE_SATURATION: {
+                const Component *lerp = &stage.lerp[p.Luminance() * 256];
+                p.r = lerp[p.r];
+                p.g = lerp[p.g];
+                p.b = lerp[p.b];
+                break;
+            }
+                
+            case STAGE_MATRIX: {
+                float r = p.r, g = p.g, b = p.b;
+                p.r = ComponentClamp((int) floor(stage.matrix[0][0] * r + stage.matrix[0][1] * g + stage.matrix[0][2] * b + 0.5f));
+                p.g = ComponentClamp((int) floor(stage.matrix[1][0] * r + stage.matrix[1][1] * g + stage.matrix[1][2] * b + 0.5f));
+                p.b = ComponentClamp((int) floor(stage.matrix[2][0] * r + stage.matrix[2][1] * g + stage.matrix[2][2] * b + 0.5f));
+                break;
+            }
+        }
+    }
+    
+    p.a = alpha[p.a];
+}
+
+
+void PointPipeline::Apply (Image *img) const {
+    if (stages.empty()) {
+        return;
+    }
+    
+    img->Unshare();
+    ParallelFor(0, img->Height(), [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            Pixel *row = img->Row(y);
+            
+            for (int x = 0; x < img->Width(); x++) {
+                Transform(row[x]);
+            }
+        }
+    });
+    img->MarkDirty();
+}
+
+
+float PointPipeline::ApplyMeanLuminance (Image *img) const {
+    // an exact integer total like Image::Stats, so the two agree exactly
+    std::vector<long long> rowTotals(img->Height());
+    img->Unshare();
+    
+    ParallelFor(0, img->Height(), [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            Pixel *row = img->Row(y);
+            long long rowTotal = 0;
+            
+            for (int x = 0; x < img->Width(); x++) {
+                Transform(row[x]);
+                rowTotal += row[x].Luminance();
+            }
+            rowTotals[y] = rowTotal;
+        }
+    });
+    
+    long long total = 0;
+    for (int y = 0; y < img->Height(); y++) {
+        total += rowTotals[y];
+    }
+    
+    img->MarkDirty();
+    return (float) total / img->NumPixels();
+}
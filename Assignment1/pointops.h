@@ -0,0 +1,94 @@
+//PointOps.h
+//
+//Fused per-pixel operations
+//
+//  A PointPipeline collects a run of per-pixel operations (ones where each
+//  output pixel only depends on the same input pixel) and applies all of them
+//  in a single pass over the image, instead of one pass per operation.
+
+#ifndef POINTOPS_INCLUDED
+#define POINTOPS_INCLUDED
+
+#include <vector>
+#include "pixel.h"
+
+class Image;
+
+class PointPipeline
+{
+public:
+    PointPipeline ();
+
+    // True if there's nothing to apply
+    bool Empty () const { return stages.empty(); }
+
+    // Forgets every operation added so far
+    void Clear ();
+
+    /**
+     * Channel independent operations.  Consecutive ones are composed into a
+     * single 256 entry table per channel, and give exactly the same result as
+     * the Image methods with the same names.
+     **/
+    void Brighten (double factor);
+    void Quantize (int nbits);
+    void ExtractChannel (int channel);
+
+    /**
+     * Same as Image::ChangeContrast, but with the mean luminance given instead
+     * of measured, since it has to come from the image as it is when the
+     * operation is reached in the chain.
+     **/
+    void ChangeContrast (double factor, Component meanLuminance);
+
+    /**
+     * Channel mixing operation.  A single one gives the same result as
+     * Image::ChangeSaturation; consecutive ones are composed into a single
+     * 3x3 color matrix.  That skips the rounding and clamping to [0..255] the
+     * intermediate steps would have done, so strong saturation followed by
+     * desaturation keeps colors that running them one at a time would clip.
+     **/
+    void ChangeSaturation (double factor);
+
+    // Applies everything added so far to the image in one pass
+    void Apply (Image *img) const;
+    
+    /**
+     * Same as Apply, but also returns the mean luminance of the result, measured
+     * in the same pass.  A ChangeContrast needs the mean of the image as the
+     * operations before it leave it, so this is how a run ending in one is applied.
+     **/
+    float ApplyMeanLuminance (Image *img) const;
+
+private:
+    enum {
+        STAGE_TABLE,        // per channel lookup tables
+        STAGE_SATURATION,   // a single ChangeSaturation, done exactly the same way the Image method does it
+        STAGE_MATRIX        // several channel mixing steps folded into one color matrix
+    };
+
+    struct Stage {
+        int type;
+        Component table[3][256];
+        std::vector<Component> lerp;    // STAGE_SATURATION: the interpolated component at [luminance * 256 + c]
+        float matrix[3][3];
+    };
+
+    // Composes an operation onto the last table stage (and the alpha table), given what the
+    // operation turns each of the 256 gray pixels (v, v, v, v) into
+    void AddTables (const Pixel *ramp);
+
+    // Runs one pixel through every stage
+    void Transform (Pixel& p) const;
+
+    // Returns the last stage if it's a table, otherwise adds an identity table stage and returns that
+    Stage& TableStage ();
+
+    std::vector<Stage> stages;
+
+    // alpha never depends on the color channels (and the other way around), so every operation's
+    // effect on it can go into one table no matter how the color stages are split up
+    Component alpha[256];
+};
+
+#endif
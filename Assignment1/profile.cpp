@@ -0,0 +1,105 @@
+//
+//  profile.cpp
+//  Assignment1
+//
+
+#include "profile.h"
+#include "image.h"
+#include "bufferpool.h"
+#include <stdio.h>
+#include <chrono>
+#include <sys/resource.h>
+using namespace std;
+
+
+static double WallSeconds () {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static double CpuSeconds () {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+
+static long long PeakRssBytes () {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;            // already in bytes
+#else
+    return usage.ru_maxrss * 1024LL;   // in kilobytes
+#endif
+}
+
+
+ChainProfile::ChainProfile () {
+    wall = cpu = 0.0;
+    pixels = bytes = 0;
+}
+
+
+void ChainProfile::Begin (const Image *img) {
+    pixels = img != NULL ? img->NumPixels() : 0;
+    bytes = ImageBytesAllocated();
+    BufferPoolStats pool = PoolStats();
+    hits = pool.hits;
+    misses = pool.misses;
+    cpu = CpuSeconds();
+    wall = WallSeconds();
+}
+
+
+void ChainProfile::End (const string& name, const Image *img) {
+    StepProfile step;
+    step.wall_ms = (WallSeconds() - wall) * 1000.0;
+    step.cpu_ms = (CpuSeconds() - cpu) * 1000.0;
+    step.name = name;
+    step.pixels_in = pixels;
+    step.pixels_out = img != NULL ? img->NumPixels() : 0;
+    step.bytes_allocated = ImageBytesAllocated() - bytes;
+    step.peak_rss_bytes = PeakRssBytes();
+    BufferPoolStats pool = PoolStats();
+    step.pool_hits = pool.hits - hits;
+    step.pool_misses = pool.misses - misses;
+    step.pool_bytes_held = pool.bytesHeld;
+    steps.push_back(step);
+}
+
+
+bool ChainProfile::Write (const char *fname) const {
+    FILE *file = fopen(fname, "w");
+    if (file == NULL) {
+        return false;
+    }
+    
+    StepProfile total = StepProfile();
+    
+    fprintf(file, "{\n  \"steps\": [\n");
+    for (size_t i = 0; i < steps.size(); i++) {
+        const StepProfile& step = steps[i];
+        fprintf(file, "    {\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"pixels_in\": %lld, \"pixels_out\": %lld, "
+                "\"bytes_allocated\": %lld, \"peak_rss_bytes\": %lld, \"pool_hits\": %lld, \"pool_misses\": %lld, "
+                "\"pool_bytes_held\": %lld}%s\n",
+                step.name.c_str(), step.wall_ms, step.cpu_ms, step.pixels_in, step.pixels_out,
+                step.bytes_allocated, step.peak_rss_bytes, step.pool_hits, step.pool_misses,
+                step.pool_bytes_held, i + 1 < steps.size() ? "," : "");
+        
+        total.wall_ms += step.wall_ms;
+        total.cpu_ms += step.cpu_ms;
+        total.bytes_allocated += step.bytes_allocated;
+        total.peak_rss_bytes = step.peak_rss_bytes;
+        total.pool_hits += step.pool_hits;
+        total.pool_misses += step.pool_misses;
+        total.pool_bytes_held = step.pool_bytes_held;
+    }
+    fprintf(file, "  ],\n  \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"bytes_allocated\": %lld, \"peak_rss_bytes\": %lld, "
+            "\"pool_hits\": %lld, \"pool_misses\": %lld, \"pool_bytes_held\": %lld}\n}\n",
+            total.wall_ms, total.cpu_ms, total.bytes_allocated, total.peak_rss_bytes,
+            total.pool_hits, total.pool_misses, total.pool_bytes_held);
+    
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,56 @@
+//Profile.h
+//
+//Per step timing and memory use of a chain
+//
+//  RunChain fills in a ChainProfile, if it's given one, with a StepProfile for
+//  every pass it makes over the image: decoding, each operation (or fused run
+//  of point operations), and encoding.  -profile writes it out as JSON.
+
+#ifndef PROFILE_INCLUDED
+#define PROFILE_INCLUDED
+
+#include <string>
+#include <vector>
+
+class Image;
+
+struct StepProfile
+{
+    std::string name;           // the operation, or the operations of a fused run joined by '+'
+    double wall_ms;
+    double cpu_ms;              // user + system time of every thread in the process
+    long long pixels_in;        // size of the image the step started with (0 when decoding)
+    long long pixels_out;       // and the one it left
+    long long bytes_allocated;  // pixel data allocated by Image during the step
+    long long peak_rss_bytes;   // high water mark of the whole process so far
+    long long pool_hits;        // pixel buffers the step got back from the buffer pool
+    long long pool_misses;      // and ones it had to allocate
+    long long pool_bytes_held;  // freed buffers the pool is keeping after the step
+};
+
+class ChainProfile
+{
+public:
+    ChainProfile ();
+
+    // Starts timing a step that runs on img (NULL before the first image is loaded)
+    void Begin (const Image *img);
+
+    // Finishes the step started by the last Begin, leaving img as the result
+    void End (const std::string& name, const Image *img);
+
+    const std::vector<StepProfile>& Steps () const { return steps; }
+
+    // Writes the steps and their totals as JSON, returning false if the file can't be written
+    bool Write (const char *fname) const;
+
+private:
+    std::vector<StepProfile> steps;
+
+    // the counters when Begin was called
+    double wall, cpu;
+    long long pixels, bytes;
+    long long hits, misses;
+};
+
+#endif
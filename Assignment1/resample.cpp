@@ -0,0 +1,445 @@
+//
+//  resample.cpp
+//  Assignment1
+//
+
+#include "resample.h"
+#include "image.h"
+#include "parallel.h"
+#include "planar.h"
+#include "warp.h"
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+/**
+ * Where WarpAffine samples a scale by (sx, sy), in its fixed point (see
+ * Warp.h): the center of output column i is over x0 + i * dx, and the
+ * center of row j over RowCenter(j).  Worked out from the same inverse, with
+ * the same arithmetic, so the scales below pick the same pixels (and, for
+ * bilinear, the same weights) as the warp.
+ **/
+struct ScalePositions
+{
+    double inverse[6];
+    int64_t x0, dx;
+    
+    ScalePositions (double sx, double sy) {
+        double m[6] = { sx, 0, 0, 0, sy, 0 };
+        InvertAffine(m, inverse);
+        x0 = llround((inverse[0] * 0.5 + inverse[2]) * FixedOne());
+        dx = llround(inverse[0] * FixedOne());
+    }
+    
+    int64_t RowCenter (int j) const {
+        return llround((inverse[3] * 0.5 + inverse[4] * (j + 0.5) + inverse[5]) * FixedOne());
+    }
+    
+    static double FixedOne () { return (double) (1LL << WARP_FRACTION_BITS); }
+};
+
+
+/**
+ * Point sampling
+ **/
+void ScalePoint (const Image& src, double sx, double sy, Image& dst) {
+    ScalePositions positions(sx, sy);
+    const int64_t bias = (int64_t) 1 << (WARP_FRACTION_BITS - 9);     // 1/512 on, like WarpAffine
+    
+    // the source column for every output column, or -1 where Sample would go off the image
+    vector<int> column(dst.Width());
+    for (int i = 0; i < dst.Width(); i++) {
+        int64_t x = positions.x0 + bias + i * positions.dx;
+        column[i] = x >= 0 && x < ((int64_t) src.Width() << WARP_FRACTION_BITS) ? (int) (x >> WARP_FRACTION_BITS) : -1;
+    }
+    
+    ParallelFor(0, dst.Height(), [&](int j0, int j1) {
+        for (int j = j0; j < j1; j++) {
+            Pixel *row = dst.Row(j);
+            int64_t y = positions.RowCenter(j) + bias;
+            
+            if (y < 0 || y >= ((int64_t) src.Height() << WARP_FRACTION_BITS)) {
+                for (int i = 0; i < dst.Width(); i++) {
+                    row[i] = Pixel();
+                }
+                continue;
+            }
+            
+            const Pixel *srcRow = src.Row((int) (y >> WARP_FRACTION_BITS));
+            for (int i = 0; i < dst.Width(); i++) {
+                row[i] = column[i] >= 0 ? srcRow[column[i]] : Pixel();
+            }
+        }
+    });
+}
+
+
+/**
+ * Bilinear sampling
+ **/
+
+// The source pixel left of (or above) center, a fixed point position, and the weight of the next one, in 1/256ths.
+// Like WarpAffine, the position is taken half a pixel back onto the grid of pixel centers (and 1/512 on, so cutting it
+// down to 1/256ths rounds it), and the edge pixels are extended past the outermost centers
+static void BilinearTap (int64_t center, int size, int *left, int *weight) {
+    int64_t x = center - ((int64_t) 1 << (WARP_FRACTION_BITS - 1)) + ((int64_t) 1 << (WARP_FRACTION_BITS - 9));
+    int64_t x0 = x >> WARP_FRACTION_BITS;
+    
+    if (x0 < 0) {
+        *left = 0;
+        *weight = 0;
+    } else if (x0 >= size - 1) {
+        // all of the weight on the last pixel, which keeps left + 1 in the image
+        *left = max(size - 2, 0);
+        *weight = size > 1 ? 256 : 0;
+    } else {
+        *left = (int) x0;
+        *weight = (int) (x >> (WARP_FRACTION_BITS - 8)) & 255;
+    }
+}
+
+
+void ScaleBilinear (const Image& src, double sx, double sy, Image& dst) {
+    assert(src.Width() >= 2);
+    int width = dst.Width();
+    ScalePositions positions(sx, sy);
+    
+    vector<int> left(width);
+    vector<uint16_t> columnWeight(width);
+    for (int i = 0; i < width; i++) {
+        int weight;
+        BilinearTap(positions.x0 + i * positions.dx, src.Width(), &left[i], &weight);
+        columnWeight[i] = weight;
+    }
+    
+    // output columns whose centers are off the source are black, as they are for Sample
+    int begin = 0, end = width;
+    ClipSpan(positions.x0, positions.dx, 0, (int64_t) src.Width() << WARP_FRACTION_BITS, &begin, &end);
+    
+    ParallelFor(0, dst.Height(), [&](int j0, int j1) {
+        // the last two source rows interpolated across, and which rows they are
+        vector<uint16_t> rows[2] = { vector<uint16_t>(width * 4), vector<uint16_t>(width * 4) };
+        int cached[2] = { -1, -1 };
+        
+        // the interpolated row y, reusing whichever cached row isn't keep
+        auto Interpolated = [&](int y, int keep) -> const uint16_t* {
+            for (int s = 0; s < 2; s++) {
+                if (cached[s] == y) {
+                    return &rows[s][0];
+                }
+            }
+            int s = cached[0] == keep ? 1 : 0;
+            BilinearRowSpan(src.Row(y), &left[0], &columnWeight[0], &rows[s][0], width);
+            cached[s] = y;
+            return &rows[s][0];
+        };
+        
+        for (int j = j0; j < j1; j++) {
+            Pixel *row = dst.Row(j);
+            int64_t center = positions.RowCenter(j);
+            if (center < 0 || center >= ((int64_t) src.Height() << WARP_FRACTION_BITS)) {
+                fill(row, row + width, Pixel());
+                continue;
+            }
+            
+            int top, weight;
+            BilinearTap(center, src.Height(), &top, &weight);
+            int bottom = min(top + 1, src.Height() - 1);
+            
+            const uint16_t *topRow = Interpolated(top, bottom);
+            const uint16_t *bottomRow = Interpolated(bottom, top);
+            BilinearBlendSpan(topRow, bottomRow, weight, (Component*) row, width * 4);
+            fill(row, row + begin, Pixel());
+            fill(row + end, row + width, Pixel());
+        }
+    });
+}
+
+
+/**
+ * Filtered
+ **/
+static double Sinc (double x) {
+    return x == 0 ? 1 : sin(M_PI * x) / (M_PI * x);
+}
+
+// Mitchell and Netravali's family of cubics, which takes b = 0, c = 0.5 for Catmull-Rom
+static double Cubic (double x, double b, double c) {
+    x = fabs(x);
+    if (x < 1) {
+        return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6;
+    }
+    if (x < 2) {
+        return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6;
+    }
+    return 0;
+}
+
+
+double FilterKernel (int filter, double x) {
+    switch (filter) {
+        case IMAGE_FILTER_BOX:
+            return x >= -0.5 && x < 0.5 ? 1 : 0;
+            
+        case IMAGE_FILTER_TRIANGLE:
+            return max(1 - fabs(x), 0.0);
+            
+        case IMAGE_FILTER_CATMULL_ROM:
+            return Cubic(x, 0, 0.5);
+            
+        case IMAGE_FILTER_MITCHELL:
+            return Cubic(x, 1.0 / 3, 1.0 / 3);
+            
+        case IMAGE_FILTER_LANCZOS3:
+            return fabs(x) < 3 ? Sinc(x) * Sinc(x / 3) : 0;
+    }
+    assert(!"not a filter");
+    return 0;
+}
+
+
+double FilterRadius (int filter) {
+    switch (filter) {
+        case IMAGE_FILTER_BOX:          return 0.5;
+        case IMAGE_FILTER_TRIANGLE:     return 1;
+        case IMAGE_FILTER_CATMULL_ROM:  return 2;
+        case IMAGE_FILTER_MITCHELL:     return 2;
+        case IMAGE_FILTER_LANCZOS3:     return 3;
+    }
+    assert(!"not a filter");
+    return 0;
+}
+
+
+/**
+ * The taps of every output pixel along one axis: output pixel i reads the
+ * source pixels [start[i], start[i] + count[i]), with the weights at
+ * weight[i * stride].  Taps past the edges are folded onto the edge pixels,
+ * so every tap is in the source.
+ **/
+struct FilterTaps
+{
+    std::vector<int> start, count;
+    std::vector<double> weight;
+    int stride;
+    
+    FilterTaps (int outSize, int inSize, double scale, int filter) {
+        // shrinking stretches the kernel over the source pixels under each output pixel
+        double stretch = max(1 / scale, 1.0);
+        double radius = FilterRadius(filter) * stretch;
+        
+        stride = min((int) ceil(2 * radius) + 2, inSize);
+        start.resize(outSize);
+        count.resize(outSize);
+        weight.assign((size_t) outSize * stride, 0.0);
+        
+        for (int i = 0; i < outSize; i++) {
+            double center = (i + 0.5) / scale - 0.5;
+            int lo = (int) floor(center - radius);
+            int hi = (int) ceil(center + radius);
+            
+            start[i] = min(max(lo, 0), inSize - 1);
+            count[i] = min(max(hi, 0), inSize - 1) - start[i] + 1;
+            assert(count[i] <= stride);
+            
+            double *w = &weight[(size_t) i * stride];
+            double total = 0;
+            for (int x = lo; x <= hi; x++) {
+                double k = FilterKernel(filter, (x - center) / stretch);
+                w[min(max(x, 0), inSize - 1) - start[i]] += k;
+                total += k;
+            }
+            
+            // an output pixel right between two box filtered source pixels can miss both
+            if (total == 0) {
+                w[min(max((int) floor(center + 0.5), 0), inSize - 1) - start[i]] = total = 1;
+            }
+            for (int k = 0; k < count[i]; k++) {
+                w[k] /= total;
+            }
+        }
+    }
+};
+
+
+void ScaleFiltered (const Image& src, double sx, double sy, int filter, Image& dst) {
+    int width = dst.Width();
+    FilterTaps columns(width, src.Width(), sx, filter);
+    FilterTaps rows(dst.Height(), src.Height(), sy, filter);
+    
+    // the columns' weights in 14 bit fixed point, rounded so each column's still add up to exactly 1,
+    // and their tap counts made even for FilterRowSpan (the extra tap has no weight)
+    int stride = (columns.stride + 1) / 2 * 2;
+    vector<int16_t> columnWeight((size_t) width * stride, 0);
+    vector<int> columnCount(width);
+    
+    for (int i = 0; i < width; i++) {
+        const double *w = &columns.weight[(size_t) i * columns.stride];
+        int16_t *fixed = &columnWeight[(size_t) i * stride];
+        int total = 0, largest = 0;
+        
+        for (int k = 0; k < columns.count[i]; k++) {
+            fixed[k] = (int16_t) lround(w[k] * (1 << 14));
+            total += fixed[k];
+            largest = fixed[k] > fixed[largest] ? k : largest;
+        }
+        fixed[largest] += (1 << 14) - total;
+        columnCount[i] = (columns.count[i] + 1) / 2 * 2;
+    }
+    
+    ParallelFor(0, dst.Height(), [&](int j0, int j1) {
+        // a source row, with room for the extra tap past its end
+        vector<Pixel> padded(src.Width() + 1);
+        vector<float> acc(width * 4);
+        
+        // the filtered source rows the window needs, row y in slot y % window
+        int window = rows.stride;
+        vector<float> filtered((size_t) window * width * 4);
+        vector<int> slot(window, -1);
+        
+        for (int j = j0; j < j1; j++) {
+            fill(acc.begin(), acc.end(), 0.0f);
+            
+            for (int k = 0; k < rows.count[j]; k++) {
+                int y = rows.start[j] + k;
+                float *row = &filtered[(size_t) (y % window) * width * 4];
+                
+                // the window only ever moves down, so a row that has dropped out of it isn't needed again
+                if (slot[y % window] != y) {
+                    copy(src.Row(y), src.Row(y) + src.Width(), padded.begin());
+                    FilterRowSpan(&padded[0], &columns.start[0], &columnCount[0], &columnWeight[0], stride, row, width);
+                    slot[y % window] = y;
+                }
+                MultiplyAddSpan(&acc[0], row, (float) rows.weight[(size_t) j * rows.stride + k], width * 4);
+            }
+            
+            RoundSpan(&acc[0], (Component*) dst.Row(j), width * 4);
+        }
+    });
+}
+
+
+/**
+ * Row kernels
+ **/
+#if defined(__SSE2__)
+
+// Each pixel and the one after it are loaded together, their channels paired up (left.r, right.r, left.g, ...)
+// and multiplied by (256 - weight, weight) with madd, which leaves the 4 channel totals in 32 bit lanes
+static inline __m128i BilinearPixel (const Pixel *src, int left, uint16_t weight) {
+    __m128i pair = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (src + left)), _mm_setzero_si128());
+    __m128i paired = _mm_unpacklo_epi16(pair, _mm_srli_si128(pair, 8));
+    __m128i weights = _mm_set1_epi32((weight << 16) | (256 - weight));
+    return _mm_srli_epi32(_mm_madd_epi16(paired, weights), 1);
+}
+
+void BilinearRowSpan (const Pixel *src, const int *left, const uint16_t *weight, uint16_t *dst, int count) {
+    int i = 0;
+    
+    for (; i + 2 <= count; i += 2) {
+        __m128i p0 = BilinearPixel(src, left[i], weight[i]);
+        __m128i p1 = BilinearPixel(src, left[i + 1], weight[i + 1]);
+        _mm_storeu_si128((__m128i*) (dst + 4 * i), _mm_packs_epi32(p0, p1));
+    }
+    
+    if (i < count) {
+        __m128i p0 = BilinearPixel(src, left[i], weight[i]);
+        _mm_storel_epi64((__m128i*) (dst + 4 * i), _mm_packs_epi32(p0, p0));
+    }
+}
+
+// 16 values at a time, with top and bottom paired up the same way as the pixels in BilinearPixel
+void BilinearBlendSpan (const uint16_t *top, const uint16_t *bottom, int weight, Component *dst, int count) {
+    const __m128i weights = _mm_set1_epi32((weight << 16) | (256 - weight));
+    const __m128i round = _mm_set1_epi32(1 << 14);
+    int i = 0;
+    
+    for (; i + 16 <= count; i += 16) {
+        __m128i halves[2];
+        
+        for (int h = 0; h < 2; h++) {
+            __m128i t = _mm_loadu_si128((const __m128i*) (top + i + 8 * h));
+            __m128i b = _mm_loadu_si128((const __m128i*) (bottom + i + 8 * h));
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(t, b), weights);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(t, b), weights);
+            lo = _mm_srli_epi32(_mm_add_epi32(lo, round), 15);
+            hi = _mm_srli_epi32(_mm_add_epi32(hi, round), 15);
+            halves[h] = _mm_packs_epi32(lo, hi);
+        }
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(halves[0], halves[1]));
+    }
+    
+    for (; i < count; i++) {
+        dst[i] = (top[i] * (256 - weight) + bottom[i] * weight + (1 << 14)) >> 15;
+    }
+}
+
+// Two taps at a time, paired up and multiplied by their weights with madd the same way as BilinearPixel
+void FilterRowSpan (const Pixel *src, const int *start, const int *count, const int16_t *weight, int stride, float *dst, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1.0f / (1 << 14));
+    
+    for (int i = 0; i < n; i++) {
+        const Pixel *taps = src + start[i];
+        const int16_t *w = weight + (size_t) i * stride;
+        __m128i sum = zero;
+        
+        for (int k = 0; k < count[i]; k += 2) {
+            __m128i pair = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (taps + k)), zero);
+            __m128i paired = _mm_unpacklo_epi16(pair, _mm_srli_si128(pair, 8));
+            __m128i weights = _mm_set1_epi32(((uint16_t) w[k + 1] << 16) | (uint16_t) w[k]);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(paired, weights));
+        }
+        _mm_storeu_ps(dst + 4 * i, _mm_mul_ps(_mm_cvtepi32_ps(sum), scale));
+    }
+}
+
+#else
+
+void BilinearRowSpan (const Pixel *src, const int *left, const uint16_t *weight, uint16_t *dst, int count) {
+    for (int i = 0; i < count; i++) {
+        const Pixel& p = src[left[i]];
+        const Pixel& q = src[left[i] + 1];
+        int w = weight[i];
+        
+        dst[4 * i + 0] = (p.r * (256 - w) + q.r * w) >> 1;
+        dst[4 * i + 1] = (p.g * (256 - w) + q.g * w) >> 1;
+        dst[4 * i + 2] = (p.b * (256 - w) + q.b * w) >> 1;
+        dst[4 * i + 3] = (p.a * (256 - w) + q.a * w) >> 1;
+    }
+}
+
+void BilinearBlendSpan (const uint16_t *top, const uint16_t *bottom, int weight, Component *dst, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = (top[i] * (256 - weight) + bottom[i] * weight + (1 << 14)) >> 15;
+    }
+}
+
+void FilterRowSpan (const Pixel *src, const int *start, const int *count, const int16_t *weight, int stride, float *dst, int n) {
+    for (int i = 0; i < n; i++) {
+        const Pixel *taps = src + start[i];
+        const int16_t *w = weight + (size_t) i * stride;
+        int sum[4] = { 0, 0, 0, 0 };
+        
+        for (int k = 0; k < count[i]; k++) {
+            sum[0] += taps[k].r * w[k];
+            sum[1] += taps[k].g * w[k];
+            sum[2] += taps[k].b * w[k];
+            sum[3] += taps[k].a * w[k];
+        }
+        for (int c = 0; c < 4; c++) {
+            dst[4 * i + c] = sum[c] * (1.0f / (1 << 14));
+        }
+    }
+}
+
+#endif
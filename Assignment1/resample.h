@@ -0,0 +1,67 @@
+//Resample.h
+//
+//Resizing a whole image
+//
+//  Scale through Sample works out every output pixel's position in the
+//  source with doubles.  For a resize the position only depends on the
+//  column and the row, so these work the source columns and rows (and the
+//  weights) out once up front and then run down whole rows.
+
+#ifndef RESAMPLE_INCLUDED
+#define RESAMPLE_INCLUDED
+
+#include <stdint.h>
+#include "pixel.h"
+
+class Image;
+
+// dst = src scaled by (sx, sy) with point sampling, taking the source pixel under each output pixel's center exactly like WarpAffine
+void ScalePoint (const Image& src, double sx, double sy, Image& dst);
+
+/**
+ * dst = src scaled by (sx, sy) with bilinear sampling.  Output pixel (i, j)
+ * is Sample((i + 0.5) / sx, (j + 0.5) / sy), the source position under its
+ * center, with the positions, weights and rounding exactly as WarpAffine
+ * has them.  The source has to be at least 2 pixels wide.
+ *
+ * Each source row the output needs is interpolated across once (16 bits per
+ * channel), and each output row is then a blend of two of those, so every
+ * source row is only read once, however many output rows it ends up in.
+ **/
+void ScaleBilinear (const Image& src, double sx, double sy, Image& dst);
+
+/**
+ * dst = src scaled by (sx, sy) with one of the IMAGE_FILTER kernels, as a
+ * horizontal and then a vertical pass.  When shrinking, the kernel is
+ * stretched to cover every source pixel that falls under an output pixel.
+ * Past the edges the edge pixels are extended.
+ *
+ * The taps and weights of every output column and row are worked out once.
+ * Each source row is filtered across (4 channels, integer weights) into a
+ * float row, and each output row is a weighted sum of a window of those,
+ * which slides down the image as the output rows go by.
+ **/
+void ScaleFiltered (const Image& src, double sx, double sy, int filter, Image& dst);
+
+// The kernel's value at x (in output pixels) and how far from 0 it's nonzero
+double FilterKernel (int filter, double x);
+double FilterRadius (int filter);
+
+/**
+ * Row kernels for ScaleBilinear.
+ **/
+
+// dst[4 * i + c] = (src[left[i]].c * (256 - weight[i]) + src[left[i] + 1].c * weight[i]) / 2, for count pixels
+void BilinearRowSpan (const Pixel *src, const int *left, const uint16_t *weight, uint16_t *dst, int count);
+
+// dst[i] = (top[i] * (256 - weight) + bottom[i] * weight + 2^14) / 2^15, for count values
+void BilinearBlendSpan (const uint16_t *top, const uint16_t *bottom, int weight, Component *dst, int count);
+
+/**
+ * Row kernel for ScaleFiltered.  Output pixel i is the sum of the taps
+ * src[start[i] + k] * weight[i * stride + k] / 2^14, for k up to count[i]
+ * (which is even).  src has to be readable up to the last tap.
+ **/
+void FilterRowSpan (const Pixel *src, const int *start, const int *count, const int16_t *weight, int stride, float *dst, int n);
+
+#endif
@@ -0,0 +1,326 @@
+//
+//  rotate.cpp
+//  Assignment1
+//
+
+#include "rotate.h"
+#include "image.h"
+#include "parallel.h"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+#define QUARTER_BLOCK 32    // quarter turns go a QUARTER_BLOCK x QUARTER_BLOCK block of pixels at a time
+
+
+/**
+ * Quarter turns
+ **/
+void RotateQuarters (const Image& src, int quarters, Image& dst) {
+    quarters = ((quarters % 4) + 4) % 4;
+    int w = src.Width(), h = src.Height(), stride = src.Stride();
+    const Pixel *pixels = src.Row(0);
+
+    if (quarters == 0 || quarters == 2) {
+        assert(dst.Width() == w && dst.Height() == h);
+
+        ParallelFor(0, h, [&](int j0, int j1) {
+            for (int j = j0; j < j1; j++) {
+                Pixel *row = dst.Row(j);
+
+                if (quarters == 0) {
+                    memcpy(row, src.Row(j), w * sizeof(Pixel));
+                } else {
+                    const Pixel *flipped = src.Row(h - 1 - j) + w - 1;
+                    for (int i = 0; i < w; i++) {
+                        row[i] = flipped[-i];
+                    }
+                }
+            }
+        });
+        return;
+    }
+
+    // each row of the result is a column of the source, so it's done in square blocks, which use every pixel
+    // of every cache line they read from the source before moving on
+    assert(dst.Width() == h && dst.Height() == w);
+    int blocks = (w + QUARTER_BLOCK - 1) / QUARTER_BLOCK;
+
+    ParallelFor(0, blocks, [&](int b0, int b1) {
+        for (int jb = b0 * QUARTER_BLOCK; jb < min(b1 * QUARTER_BLOCK, w); jb += QUARTER_BLOCK) {
+            int jEnd = min(jb + QUARTER_BLOCK, w);
+
+            for (int ib = 0; ib < h; ib += QUARTER_BLOCK) {
+                int iEnd = min(ib + QUARTER_BLOCK, h);
+
+                for (int j = jb; j < jEnd; j++) {
+                    Pixel *row = dst.Row(j);
+
+                    if (quarters == 1) {
+                        // dst(i, j) = src(j, h - 1 - i)
+                        for (int i = ib; i < iEnd; i++) {
+                            row[i] = pixels[(size_t) (h - 1 - i) * stride + j];
+                        }
+                    } else {
+                        // dst(i, j) = src(w - 1 - j, i)
+                        for (int i = ib; i < iEnd; i++) {
+                            row[i] = pixels[(size_t) i * stride + (w - 1 - j)];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+
+/**
+ * Shears
+ **/
+
+// Splits a shift of offset pixels into the whole pixels k and the 1/256ths past them, weight
+static void SplitOffset (double offset, bool interpolate, int *k, uint16_t *weight) {
+    if (!interpolate) {
+        *k = (int) floor(offset + 0.5);
+        *weight = 0;
+        return;
+    }
+
+    *k = (int) floor(offset);
+    int w = (int) ((offset - *k) * 256 + 0.5);
+    if (w == 256) {
+        (*k)++;
+        w = 0;
+    }
+    *weight = w;
+}
+
+
+// dst = src with each row j slid right by offset(j) pixels.  Output pixel i of the row is the source at i - offset(j)
+template <class Offset>
+static void ShearRows (const Image& src, Offset offset, bool interpolate, Image& dst) {
+    assert(dst.Height() == src.Height());
+    int w = src.Width(), width = dst.Width();
+
+    ParallelFor(0, dst.Height(), [&](int j0, int j1) {
+        vector<uint16_t> weights(width);
+
+        for (int j = j0; j < j1; j++) {
+            const Pixel *in = src.Row(j);
+            Pixel *out = dst.Row(j);
+
+            int k;
+            uint16_t weight;
+            SplitOffset(offset(j), interpolate, &k, &weight);
+
+            // out[i] blends in[i - k] and in[i - k - 1], so pixels k + 1 up to k + w - 1 have both,
+            // k and k + w have one of them and black, and the rest are black
+            int begin = min(max(k + 1, 0), width), end = max(min(k + w, width), begin);
+
+            fill(out, out + begin, Pixel());
+            fill(out + end, out + width, Pixel());
+            fill(weights.begin() + begin, weights.begin() + end, weight);
+            ShearSpan(in + begin - k, in + begin - k - 1, &weights[0] + begin, out + begin, end - begin);
+
+            Pixel black;
+            if (k >= 0 && k < width) {
+                ShearSpan(in, &black, &weight, out + k, 1);
+            }
+            if (k + w >= 0 && k + w < width && weight > 0) {
+                ShearSpan(&black, in + w - 1, &weight, out + k + w, 1);
+            }
+        }
+    });
+}
+
+
+// dst = src with each column i slid down by offset(i) pixels.  Output pixel j of the column is the source at j - offset(i)
+template <class Offset>
+static void ShearColumns (const Image& src, Offset offset, bool interpolate, Image& dst) {
+    assert(dst.Width() == src.Width());
+    int width = dst.Width(), h = src.Height();
+
+    vector<int> shift(width);
+    vector<uint16_t> weights(width);
+    for (int i = 0; i < width; i++) {
+        SplitOffset(offset(i), interpolate, &shift[i], &weights[i]);
+    }
+
+    // the columns come in runs with the same whole shift, which take the same two source rows, so the
+    // output still goes a row at a time, as a span per run.  Rows off the source read from a black one
+    vector<Pixel> black(width);
+
+    ParallelFor(0, dst.Height(), [&](int j0, int j1) {
+        for (int j = j0; j < j1; j++) {
+            Pixel *out = dst.Row(j);
+
+            for (int i = 0; i < width; ) {
+                int k = shift[i];
+                int end = i + 1;
+                while (end < width && shift[end] == k) {
+                    end++;
+                }
+
+                const Pixel *a = (j - k >= 0 && j - k < h) ? src.Row(j - k) : &black[0];
+                const Pixel *b = (j - k - 1 >= 0 && j - k - 1 < h) ? src.Row(j - k - 1) : &black[0];
+                ShearSpan(a + i, b + i, &weights[i], out + i, end - i);
+                i = end;
+            }
+        }
+    });
+}
+
+
+/**
+ * Splits angle into whole quarter turns and what's left, within 45 degrees
+ * either way.  What's left comes out 0 if turning a w x h image by it
+ * wouldn't move the far edge by half a pixel, so an angle typed to a few
+ * places (1.5708) is still a quarter turn.
+ **/
+static int SplitQuarters (double angle, int w, int h, double *rest) {
+    int quarters = (int) floor(angle / (M_PI / 2) + 0.5);
+    *rest = angle - quarters * (M_PI / 2);
+    if (fabs(*rest) * max(w, h) < 0.5) {
+        *rest = 0;
+    }
+    return quarters;
+}
+
+
+bool IsQuarterTurn (double angle, int w, int h) {
+    double rest;
+    SplitQuarters(angle, w, h, &rest);
+    return rest == 0;
+}
+
+
+void RotatedSize (int w, int h, double angle, int *rotatedWidth, int *rotatedHeight) {
+    // worked out the way RotateAboutCenter turns the image, so it comes out exactly the same size
+    double rest;
+    if (SplitQuarters(angle, w, h, &rest) % 2) {
+        swap(w, h);
+    }
+
+    double c = fabs(cos(rest)), s = fabs(sin(rest));
+
+    // a little slack, so a size worked out in floating point doesn't come out a pixel too big
+    *rotatedWidth = max((int) ceil(w * c + h * s - 1e-6), 1);
+    *rotatedHeight = max((int) ceil(w * s + h * c - 1e-6), 1);
+}
+
+
+void CenteredRotation (int w, int h, double angle, double m[6], int *rotatedWidth, int *rotatedHeight) {
+    RotatedSize(w, h, angle, rotatedWidth, rotatedHeight);
+
+    double c = cos(angle), s = sin(angle);
+    m[0] = c;
+    m[1] = -s;
+    m[2] = *rotatedWidth / 2.0 - (c * w / 2.0 - s * h / 2.0);
+    m[3] = s;
+    m[4] = c;
+    m[5] = *rotatedHeight / 2.0 - (s * w / 2.0 + c * h / 2.0);
+}
+
+
+Image RotateByShears (const Image& src, double angle, bool interpolate) {
+    // R(angle) = X(alpha) Y(beta) X(alpha), where X slides rows across and Y slides columns down
+    double alpha = -tan(angle / 2), beta = sin(angle);
+    int w = src.Width(), h = src.Height();
+
+    // the first shear widens the image, the second one makes it as tall as the result, and the last one
+    // brings it in to the result's width.  Positions are measured from the middle of each image
+    int across = (int) ceil(w + fabs(alpha) * h - 1e-6);
+    int width, height;
+    RotatedSize(w, h, angle, &width, &height);
+
+    Image first(across, h);
+    ShearRows(src, [&](int j) { return alpha * (j + 0.5 - h / 2.0) + (across - w) / 2.0; }, interpolate, first);
+
+    Image second(across, height);
+    ShearColumns(first, [&](int i) { return beta * (i + 0.5 - across / 2.0) + (height - h) / 2.0; }, interpolate, second);
+
+    Image rotated(width, height);
+    ShearRows(second, [&](int j) { return alpha * (j + 0.5 - height / 2.0) + (width - across) / 2.0; }, interpolate, rotated);
+
+    return rotated;
+}
+
+
+
+Image RotateAboutCenter (const Image& src, double angle, bool interpolate) {
+    double rest;
+    int quarters = SplitQuarters(angle, src.Width(), src.Height(), &rest);
+    if (quarters % 4 == 0) {
+        // nothing to turn first, and a copy only shares src's pixels
+        return rest == 0 ? Image(src) : RotateByShears(src, rest, interpolate);
+    }
+
+    Image turned = (quarters % 2) ? Image(src.Height(), src.Width()) : Image(src.Width(), src.Height());
+    RotateQuarters(src, quarters, turned);
+    if (rest == 0) {
+        return turned;
+    }
+
+    return RotateByShears(turned, rest, interpolate);
+}
+
+/**
+ * Span kernel
+ **/
+#if defined(__SSE2__)
+
+// 4 pixels at a time, in 16 bit lanes.  Each weight is spread over its pixel's 4 channels
+void ShearSpan (const Pixel *a, const Pixel *b, const uint16_t *weight, Pixel *dst, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(256);
+    const __m128i round = _mm_set1_epi16(128);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i pa = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i pb = _mm_loadu_si128((const __m128i*) (b + i));
+        __m128i w = _mm_loadl_epi64((const __m128i*) (weight + i));
+        w = _mm_unpacklo_epi16(w, w);
+        __m128i wlo = _mm_unpacklo_epi32(w, w);
+        __m128i whi = _mm_unpackhi_epi32(w, w);
+
+        // at most 255 * 256 + 128, which still fits in an unsigned 16 bit lane
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pa, zero), _mm_sub_epi16(full, wlo)),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(pb, zero), wlo));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pa, zero), _mm_sub_epi16(full, whi)),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(pb, zero), whi));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    for (; i < count; i++) {
+        int wb = weight[i], wa = 256 - wb;
+        dst[i] = Pixel((a[i].r * wa + b[i].r * wb + 128) >> 8,
+                       (a[i].g * wa + b[i].g * wb + 128) >> 8,
+                       (a[i].b * wa + b[i].b * wb + 128) >> 8,
+                       (a[i].a * wa + b[i].a * wb + 128) >> 8);
+    }
+}
+
+#else
+
+void ShearSpan (const Pixel *a, const Pixel *b, const uint16_t *weight, Pixel *dst, int count) {
+    for (int i = 0; i < count; i++) {
+        int wb = weight[i], wa = 256 - wb;
+        dst[i] = Pixel((a[i].r * wa + b[i].r * wb + 128) >> 8,
+                       (a[i].g * wa + b[i].g * wb + 128) >> 8,
+                       (a[i].b * wa + b[i].b * wb + 128) >> 8,
+                       (a[i].a * wa + b[i].a * wb + 128) >> 8);
+    }
+}
+
+#endif
@@ -0,0 +1,58 @@
+//Rotate.h
+//
+//Rotating a whole image
+//
+//  A rotation is the same as three shears, across, down and across again
+//  (Paeth, "A Fast Algorithm for General Raster Rotation").  Each shear
+//  just slides every row (or column) along by its own amount, so instead of
+//  working out a source position per pixel with sines and cosines, a shear
+//  is a copy of runs of pixels with a blend between each pixel and its
+//  neighbour.  The shears get less accurate past 45 degrees, so whole
+//  quarter turns are taken off first and done exactly.
+
+#ifndef ROTATE_INCLUDED
+#define ROTATE_INCLUDED
+
+#include <stdint.h>
+#include "pixel.h"
+
+class Image;
+
+/**
+ * dst = src turned quarters quarter turns the way Rotate turns it (clockwise
+ * on screen, since y goes down), exactly.  dst is src's size, with width and
+ * height swapped for odd quarters.  Quarters can be anything; 0 copies.
+ **/
+void RotateQuarters (const Image& src, int quarters, Image& dst);
+
+/**
+ * src rotated by angle (in radians, clockwise on screen) about its center,
+ * as three shears, on a canvas just big enough for all of it.  With
+ * interpolate each shear blends neighbouring pixels by how far between them
+ * the shifted position falls (to 1/256); without it, every row or column is
+ * shifted a whole number of pixels, so each output pixel is a copy of one
+ * source pixel.  Anything the source doesn't cover is black.  The angle
+ * should be within 45 degrees either way; RotateQuarters does the rest.
+ **/
+Image RotateByShears (const Image& src, double angle, bool interpolate);
+
+/**
+ * src rotated by any angle about its center onto a canvas just big enough
+ * for all of it: whole quarter turns with RotateQuarters, and whatever is
+ * left over (within 45 degrees) with RotateByShears.
+ **/
+Image RotateAboutCenter (const Image& src, double angle, bool interpolate);
+
+// True if RotateAboutCenter turns a w x h image by angle with RotateQuarters alone, as an exact copy
+bool IsQuarterTurn (double angle, int w, int h);
+
+// The size of the canvas RotateAboutCenter puts a w x h image rotated by angle on
+void RotatedSize (int w, int h, double angle, int *rotatedWidth, int *rotatedHeight);
+
+// m = the affine map (see Warp.h) that turns a w x h image about its center onto the middle of that canvas
+void CenteredRotation (int w, int h, double angle, double m[6], int *rotatedWidth, int *rotatedHeight);
+
+// dst[i] = (a[i] * (256 - weight[i]) + b[i] * weight[i] + 128) / 256, for count pixels
+void ShearSpan (const Pixel *a, const Pixel *b, const uint16_t *weight, Pixel *dst, int count);
+
+#endif
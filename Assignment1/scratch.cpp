@@ -0,0 +1,84 @@
+//
+//  scratch.cpp
+//  Assignment1
+//
+
+#include "scratch.h"
+#include "bufferpool.h"
+#include <assert.h>
+
+
+namespace {
+
+struct ThreadScratch
+{
+    void *buffers[SCRATCH_N_SLOTS];
+    size_t bytes[SCRATCH_N_SLOTS];
+    void *spare;                // the last pixel buffer the thread let go of
+    size_t spareBytes;
+
+    ThreadScratch () : buffers(), bytes(), spare(NULL), spareBytes(0) {}
+    ~ThreadScratch () { Trim(); }
+
+    void Trim () {
+        for (int slot = 0; slot < SCRATCH_N_SLOTS; slot++) {
+            if (buffers[slot] != NULL) {
+                PoolRelease(buffers[slot], bytes[slot]);
+            }
+            buffers[slot] = NULL;
+            bytes[slot] = 0;
+        }
+
+        if (spare != NULL) {
+            PoolRelease(spare, spareBytes);
+        }
+        spare = NULL;
+        spareBytes = 0;
+    }
+};
+
+thread_local ThreadScratch scratch;
+
+}
+
+
+void* ScratchBytes (int slot, size_t bytes) {
+    assert(slot >= 0 && slot < SCRATCH_N_SLOTS);
+
+    if (bytes > scratch.bytes[slot] || scratch.buffers[slot] == NULL) {
+        // nothing in it needs keeping, so there's no point copying it over
+        if (scratch.buffers[slot] != NULL) {
+            PoolRelease(scratch.buffers[slot], scratch.bytes[slot]);
+        }
+        bytes = bytes > 0 ? bytes : 1;
+        scratch.buffers[slot] = PoolAllocate(bytes);
+        scratch.bytes[slot] = bytes;
+    }
+    return scratch.buffers[slot];
+}
+
+
+void* TakeSparePixels (size_t bytes) {
+    if (scratch.spare == NULL || scratch.spareBytes != bytes) {
+        return PoolAllocate(bytes);
+    }
+
+    void *buffer = scratch.spare;
+    scratch.spare = NULL;
+    scratch.spareBytes = 0;
+    return buffer;
+}
+
+
+void KeepSparePixels (void *buffer, size_t bytes) {
+    if (scratch.spare != NULL) {
+        PoolRelease(scratch.spare, scratch.spareBytes);
+    }
+    scratch.spare = buffer;
+    scratch.spareBytes = bytes;
+}
+
+
+void ScratchTrim () {
+    scratch.Trim();
+}
@@ -0,0 +1,59 @@
+//Scratch.h
+//
+//Per-thread scratch memory for the stencil filters
+//
+//  A stencil filter reads from a snapshot of the image while it writes the
+//  image, and each band works through its rows with a few rows of working
+//  space.  Asking the buffer pool (or the heap, for the rows) for those on
+//  every call takes its lock and goes through its bookkeeping each time, so
+//  instead every thread keeps a buffer per slot for itself.  A slot's buffer
+//  grows to the biggest size it's been asked for and then stays, so after
+//  the first call at a given size a filter gets its memory back without
+//  allocating anything.
+//
+//  Each thread also keeps the last image buffer it let go of.  A filter
+//  that can't write over the image it's reading (because a copy shares its
+//  pixels, or because it needs a second image, like Sharpen) writes into a
+//  new buffer and the image's old one is let go of, so from one call to the
+//  next the two buffers just trade places.  A thread's buffers go back to
+//  the pool when it ends, or when it calls ScratchTrim.  RunChain does at
+//  the end of every chain, so in between chains the snapshot and the spare
+//  count against the pool's limit (IMAGE_POOL_MB) like any other freed
+//  buffer, and only the pool threads' working rows are held on to.
+
+#ifndef SCRATCH_INCLUDED
+#define SCRATCH_INCLUDED
+
+#include <stddef.h>
+
+enum {
+    SCRATCH_SNAPSHOT,       // the copy of the image a filter reads from, taken on the calling thread
+    SCRATCH_TABLE,          // small per call tables, like kernel weights, also on the calling thread
+    SCRATCH_ROWS,           // working rows of a band, on whichever thread runs it
+    SCRATCH_N_SLOTS
+};
+
+/**
+ * At least bytes of the calling thread's memory for slot, aligned like a
+ * pool buffer.  It holds whatever was last left in it, and stays the
+ * thread's until the next call for the same slot, so one user can't nest
+ * inside another of the same slot on the same thread.
+ **/
+void* ScratchBytes (int slot, size_t bytes);
+
+// count Ts of the calling thread's memory for slot
+template <class T>
+T* Scratch (int slot, size_t count) {
+    return (T*) ScratchBytes(slot, count * sizeof(T));
+}
+
+// A pixel buffer of bytes: the calling thread's spare one if it's that size, and otherwise one from the pool
+void* TakeSparePixels (size_t bytes);
+
+// Keeps a pixel buffer of bytes from TakeSparePixels as the calling thread's spare, giving the one it had back to the pool
+void KeepSparePixels (void *buffer, size_t bytes);
+
+// Gives the calling thread's scratch buffers, and its spare, back to the pool
+void ScratchTrim ();
+
+#endif
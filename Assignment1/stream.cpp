@@ -0,0 +1,258 @@
+//
+//  stream.cpp
+//  Assignment1
+//
+
+#include "stream.h"
+#include "image.h"
+#include "integral.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+using namespace std;
+
+
+/**
+ * Header parsing
+ **/
+
+// Reads the next whitespace separated word of a PNM header into token, skipping # comments
+static bool ReadToken (FILE *file, char *token, int size) {
+    int c = fgetc(file);
+
+    while (c != EOF && (isspace(c) || c == '#')) {
+        if (c == '#') {
+            while (c != EOF && c != '\n') {
+                c = fgetc(file);
+            }
+        }
+        c = fgetc(file);
+    }
+
+    int n = 0;
+    while (c != EOF && !isspace(c) && n < size - 1) {
+        token[n++] = c;
+        c = fgetc(file);
+    }
+    token[n] = '\0';
+
+    // the single whitespace character after the last header field is left consumed on purpose,
+    // since the binary data starts right after it
+    return n > 0;
+}
+
+static int ReadNumber (FILE *file) {
+    char token[32];
+    return ReadToken(file, token, sizeof(token)) ? atoi(token) : -1;
+}
+
+
+/**
+ * RowReader
+ **/
+RowReader::RowReader (const char *fname_) {
+    fname = fname_;
+    width = height = depth = 0;
+    int maxval = 0;
+
+    file = fopen(fname, "rb");
+    if (file == NULL) {
+        printf("Error loading image: %s", fname);
+        exit(-1);
+    }
+
+    char token[32];
+    ReadToken(file, token, sizeof(token));
+
+    if (!strcmp(token, "P6")) {
+        width = ReadNumber(file);
+        height = ReadNumber(file);
+        maxval = ReadNumber(file);
+        depth = 3;
+    } else if (!strcmp(token, "P7")) {
+        while (ReadToken(file, token, sizeof(token)) && strcmp(token, "ENDHDR")) {
+            if (!strcmp(token, "WIDTH")) {
+                width = ReadNumber(file);
+            } else if (!strcmp(token, "HEIGHT")) {
+                height = ReadNumber(file);
+            } else if (!strcmp(token, "DEPTH")) {
+                depth = ReadNumber(file);
+            } else if (!strcmp(token, "MAXVAL")) {
+                maxval = ReadNumber(file);
+            } else if (!strcmp(token, "TUPLTYPE")) {
+                ReadToken(file, token, sizeof(token));
+            }
+        }
+    }
+
+    if (width <= 0 || height <= 0 || maxval != 255 || (depth != 3 && depth != 4)) {
+        printf("Error loading image: %s (only 8 bit binary PPM and RGB/RGBA PAM files can be streamed)", fname);
+        exit(-1);
+    }
+
+    buffer.resize((size_t) width * depth);
+}
+
+
+RowReader::~RowReader () {
+    fclose(file);
+}
+
+
+void RowReader::ReadRows (Pixel *dst, int rows) {
+    for (int j = 0; j < rows; j++) {
+        if (fread(&buffer[0], depth, width, file) != (size_t) width) {
+            printf("Error loading image: %s (file is truncated)", fname);
+            exit(-1);
+        }
+
+        const uint8_t *src = &buffer[0];
+        for (int i = 0; i < width; i++, src += depth) {
+            dst[i] = Pixel(src[0], src[1], src[2], depth == 4 ? src[3] : 255);
+        }
+        dst += width;
+    }
+}
+
+
+/**
+ * RowWriter
+ **/
+RowWriter::RowWriter (const char *fname_, int width_, int height) {
+    fname = fname_;
+    width = width_;
+
+    int length = strlen(fname);
+    depth = (length > 4 && !strcmp(fname + length - 4, ".pam")) ? 4 : 3;
+
+    file = fopen(fname, "wb");
+    if (file == NULL) {
+        printf("Error writing image: %s", fname);
+        exit(-1);
+    }
+
+    if (depth == 4) {
+        fprintf(file, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", width, height);
+    } else {
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+    }
+
+    buffer.resize((size_t) width * depth);
+}
+
+
+RowWriter::~RowWriter () {
+    fclose(file);
+}
+
+
+void RowWriter::WriteRows (const Pixel *src, int rows) {
+    for (int j = 0; j < rows; j++) {
+        uint8_t *dst = &buffer[0];
+        for (int i = 0; i < width; i++, dst += depth) {
+            dst[0] = src[i].r;
+            dst[1] = src[i].g;
+            dst[2] = src[i].b;
+            if (depth == 4) {
+                dst[3] = src[i].a;
+            }
+        }
+
+        if (fwrite(&buffer[0], depth, width, file) != (size_t) width) {
+            printf("Error writing image: %s", fname);
+            exit(-1);
+        }
+        src += width;
+    }
+}
+
+
+/**
+ * Streaming chains
+ **/
+bool IsStreamOperation (int type) {
+    switch (type) {
+        case OP_BRIGHTNESS:
+        case OP_SATURATION:
+        case OP_EXTRACT_CHANNEL:
+        case OP_QUANTIZE:
+        case OP_BLUR:
+        case OP_SHARPEN:
+        case OP_EDGE_DETECT:
+        case OP_BOX_BLUR:
+        case OP_FAST_BLUR:
+            return true;
+    }
+
+    // contrast, equalize, autolevels and histogram need statistics of the whole image, and the rest either move pixels
+    // around or depend on the order the whole image is visited in
+    return false;
+}
+
+
+int OperationHalo (const Operation& op) {
+    switch (op.type) {
+        case OP_BLUR:
+        case OP_SHARPEN:
+            return (int) op.args[0] / 2;
+
+        case OP_EDGE_DETECT:
+            return 1;
+            
+        case OP_BOX_BLUR:
+            // each pass reads radius rows further out of what the last one wrote
+            return (int) op.args[0] * max((int) op.args[1], 1);
+            
+        case OP_FAST_BLUR: {
+            int radii[3];
+            GaussianBoxRadii(op.args[0], 3, radii);
+            return radii[0] + radii[1] + radii[2];
+        }
+    }
+    return 0;
+}
+
+
+void StreamChain (const char *inputName, const char *outputName, const Chain& chain, int bandRows, int format) {
+    RowReader reader(inputName);
+    int width = reader.Width();
+    int height = reader.Height();
+
+    // each stencil in the chain widens the area the next one's input has to be right over
+    int halo = 0;
+    for (size_t i = 0; i < chain.size(); i++) {
+        assert(IsStreamOperation(chain[i].type));
+        halo += OperationHalo(chain[i]);
+    }
+
+    bandRows = max(bandRows, 1);
+    RowWriter writer(outputName, width, height);
+
+    // input rows [windowBegin, windowEnd), the band plus its halo
+    vector<Pixel> window;
+    int windowBegin = 0;
+    int windowEnd = 0;
+
+    for (int bandBegin = 0; bandBegin < height; bandBegin += bandRows) {
+        int bandEnd = min(bandBegin + bandRows, height);
+        int needBegin = max(bandBegin - halo, 0);
+        int needEnd = min(bandEnd + halo, height);
+
+        // drop the rows no later band needs, then read the new ones in after the rest
+        window.erase(window.begin(), window.begin() + (size_t) (needBegin - windowBegin) * width);
+        windowBegin = needBegin;
+
+        window.resize((size_t) (needEnd - windowBegin) * width);
+        reader.ReadRows(&window[(size_t) (windowEnd - windowBegin) * width], needEnd - windowEnd);
+        windowEnd = needEnd;
+
+        // the halo rows at the edges of the band come out wrong, but only the rows they're there for get written.
+        // at the top and bottom of the image the band edge is the image edge, so the filters handle those the usual way
+        Image band(width, needEnd - needBegin);
+        memcpy(band.data.raw, &window[0], window.size() * sizeof(Pixel));
+        RunChain(&band, chain, NULL, format);
+
+        writer.WriteRows(band.Row(bandBegin - needBegin), bandEnd - bandBegin);
+    }
+}
@@ -0,0 +1,77 @@
+//Stream.h
+//
+//Streaming images a band of rows at a time
+//
+//  For images too big to hold in memory, a chain can be run over a band of
+//  rows at a time, read from and written to formats that can be streamed a
+//  row at a time: binary PPM (P6) and PAM (P7, RGB or RGB_ALPHA).  Stencil
+//  filters get extra halo rows above and below each band, so the output is
+//  the same as running the chain on the whole image.
+
+#ifndef STREAM_INCLUDED
+#define STREAM_INCLUDED
+
+#include <stdio.h>
+#include <vector>
+#include "chain.h"
+#include "pixel.h"
+
+/**
+ * RowReader - reads a PPM or PAM file from the top down
+ **/
+class RowReader
+{
+public:
+    // Opens the file and reads its header (exits on error, like Image(char*))
+    RowReader (const char *fname);
+    ~RowReader ();
+
+    int Width  () const { return width; }
+    int Height () const { return height; }
+
+    // Reads the next rows of the image into dst, which holds rows * Width() pixels
+    void ReadRows (Pixel *dst, int rows);
+
+private:
+    FILE *file;
+    const char *fname;
+    int width, height;
+    int depth;                      // 3 for RGB, 4 for RGBA
+    std::vector<uint8_t> buffer;    // one row as it is in the file
+};
+
+/**
+ * RowWriter - writes a PPM (RGB) or, if the name ends in .pam, a PAM (RGBA) file from the top down
+ **/
+class RowWriter
+{
+public:
+    RowWriter (const char *fname, int width, int height);
+    ~RowWriter ();
+
+    // Writes the next rows of the image from src, which holds rows * width pixels
+    void WriteRows (const Pixel *src, int rows);
+
+private:
+    FILE *file;
+    const char *fname;
+    int width;
+    int depth;
+    std::vector<uint8_t> buffer;
+};
+
+// True for operations that can run on a band of rows on its own (given its halo)
+bool IsStreamOperation (int type);
+
+// Number of rows above and below a band the operation reads from
+int OperationHalo (const Operation& op);
+
+/**
+ * Runs the chain (which must only hold stream operations) from the input file
+ * to the output file, bandRows rows at a time.  Only about bandRows plus the
+ * halos of the chain's operations are held in memory, whatever the image size.
+ * format is passed on to RunChain for each band.
+ **/
+void StreamChain (const char *inputName, const char *outputName, const Chain& chain, int bandRows, int format = CHAIN_8BIT);
+
+#endif
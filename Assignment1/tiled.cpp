@@ -0,0 +1,77 @@
+//
+//  tiled.cpp
+//  Assignment1
+//
+
+#include "tiled.h"
+#include "image.h"
+#include "parallel.h"
+#include "bufferpool.h"
+#include <string.h>
+using namespace std;
+
+
+// Spreads the bits of v out to every other bit, so x and y can be interleaved as spread(x) | spread(y) << 1
+static size_t SpreadBits (size_t v) {
+    size_t spread = 0;
+    for (int bit = 0; v >> bit; bit++) {
+        spread |= ((v >> bit) & 1) << (2 * bit);
+    }
+    return spread;
+}
+
+
+TiledImage::TiledImage (const Image& img) {
+    width = img.Width();
+    height = img.Height();
+    
+    int tilesX = (width + TILE_SIZE - 1) >> TILE_BITS;
+    int tilesY = (height + TILE_SIZE - 1) >> TILE_BITS;
+    
+    // Morton order needs a square, power of two grid of tiles.  Rather than padding a long,
+    // thin image out to one, the tiles go in squares the size of its short side, and the
+    // squares go one after another along the long side
+    int squareBits = 0;
+    while ((1 << squareBits) < min(tilesX, tilesY)) {
+        squareBits++;
+    }
+    int squareSide = 1 << squareBits;
+    size_t squareTiles = (size_t) squareSide * squareSide;
+    
+    vector<size_t> tileX(tilesX), tileY(tilesY);
+    for (int tx = 0; tx < tilesX; tx++) {
+        tileX[tx] = (tx >> squareBits) * squareTiles + SpreadBits(tx & (squareSide - 1));
+    }
+    for (int ty = 0; ty < tilesY; ty++) {
+        tileY[ty] = (ty >> squareBits) * squareTiles + (SpreadBits(ty & (squareSide - 1)) << 1);
+    }
+    size_t tiles = tileX[tilesX - 1] + tileY[tilesY - 1] + 1;
+    
+    columnOffset.resize(width);
+    rowOffset.resize(height);
+    for (int x = 0; x < width; x++) {
+        columnOffset[x] = (tileX[x >> TILE_BITS] << (2 * TILE_BITS)) + (x & (TILE_SIZE - 1));
+    }
+    for (int y = 0; y < height; y++) {
+        rowOffset[y] = (tileY[y >> TILE_BITS] << (2 * TILE_BITS)) + ((y & (TILE_SIZE - 1)) << TILE_BITS);
+    }
+    
+    size = (tiles << (2 * TILE_BITS)) * sizeof(Pixel);
+    pixels = (Pixel*) PoolAllocate(size);
+    
+    // a tile row at a time, each tile a row of TILE_SIZE pixels at a time
+    ParallelFor(0, tilesY, [&](int ty0, int ty1) {
+        for (int y = ty0 << TILE_BITS; y < min(ty1 << TILE_BITS, height); y++) {
+            const Pixel *src = img.Row(y);
+            
+            for (int x = 0; x < width; x += TILE_SIZE) {
+                memcpy(&pixels[columnOffset[x] + rowOffset[y]], src + x, min(TILE_SIZE, width - x) * sizeof(Pixel));
+            }
+        }
+    });
+}
+
+
+TiledImage::~TiledImage () {
+    PoolRelease(pixels, size);
+}
@@ -0,0 +1,220 @@
+//
+//  warp.cpp
+//  Assignment1
+//
+
+#include "warp.h"
+#include "image.h"
+#include "parallel.h"
+#include "tiled.h"
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+static const double FIXED_ONE = (double) (1LL << WARP_FRACTION_BITS);
+
+
+bool InvertAffine (const double m[6], double inverse[6]) {
+    double det = m[0] * m[4] - m[1] * m[3];
+    if (fabs(det) < 1e-12) {
+        return false;
+    }
+
+    inverse[0] =  m[4] / det;
+    inverse[1] = -m[1] / det;
+    inverse[3] = -m[3] / det;
+    inverse[4] =  m[0] / det;
+    inverse[2] = -(inverse[0] * m[2] + inverse[1] * m[5]);
+    inverse[5] = -(inverse[3] * m[2] + inverse[4] * m[5]);
+    return true;
+}
+
+
+void ComposeAffine (const double first[6], const double then[6], double result[6]) {
+    double m[6];
+    m[0] = then[0] * first[0] + then[1] * first[3];
+    m[1] = then[0] * first[1] + then[1] * first[4];
+    m[2] = then[0] * first[2] + then[1] * first[5] + then[2];
+    m[3] = then[3] * first[0] + then[4] * first[3];
+    m[4] = then[3] * first[1] + then[4] * first[4];
+    m[5] = then[3] * first[2] + then[4] * first[5] + then[5];
+    copy(m, m + 6, result);
+}
+
+
+void AffineBounds (const double m[6], int w, int h, int *boundsWidth, int *boundsHeight) {
+    double right = 0, bottom = 0;
+    for (int corner = 0; corner < 4; corner++) {
+        double x = (corner & 1) ? w : 0, y = (corner & 2) ? h : 0;
+        right = max(right, m[0] * x + m[1] * y + m[2]);
+        bottom = max(bottom, m[3] * x + m[4] * y + m[5]);
+    }
+
+    // a little slack, so a corner that lands on a pixel edge in floating point doesn't add a pixel
+    *boundsWidth = max((int) ceil(right - 1e-6), 1);
+    *boundsHeight = max((int) ceil(bottom - 1e-6), 1);
+}
+
+
+// floor(a / b), for b > 0
+static int64_t FloorDiv (int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+
+void ClipSpan (int64_t start, int64_t step, int64_t lo, int64_t hi, int *begin, int *end) {
+    int64_t first, last;
+
+    if (step == 0) {
+        first = (start >= lo && start < hi) ? *begin : *end;
+        last = *end;
+    } else if (step > 0) {
+        // i >= (lo - start) / step and i < (hi - start) / step, rounded up
+        first = -FloorDiv(start - lo, step);
+        last = -FloorDiv(start - hi, step);
+    } else {
+        // i > (start - hi) / -step and i <= (start - lo) / -step, rounded down
+        first = FloorDiv(start - hi, -step) + 1;
+        last = FloorDiv(start - lo, -step) + 1;
+    }
+
+    *begin = (int) max<int64_t>(*begin, min<int64_t>(first, *end));
+    *end = (int) max<int64_t>(*begin, min<int64_t>(last, *end));
+}
+
+
+// Bilinear blend of 4 pixels, with fx and fy in 1/256ths.  The blends across are halved to 15 bits before the
+// one down, the way ScaleBilinear's row kernels have to, so a scale comes out the same from either of them
+static inline int Blend (int a, int b, int c, int d, int fx, int fy) {
+    return (((a * (256 - fx) + b * fx) >> 1) * (256 - fy) + ((c * (256 - fx) + d * fx) >> 1) * fy + (1 << 14)) >> 15;
+}
+
+static inline Pixel BlendPixels (const Pixel& p00, const Pixel& p10, const Pixel& p01, const Pixel& p11, int fx, int fy) {
+    return Pixel(Blend(p00.r, p10.r, p01.r, p11.r, fx, fy),
+                 Blend(p00.g, p10.g, p01.g, p11.g, fx, fy),
+                 Blend(p00.b, p10.b, p01.b, p11.b, fx, fy),
+                 Blend(p00.a, p10.a, p01.a, p11.a, fx, fy));
+}
+
+
+// WarpAffine's rows, reading pixels from source (the image itself, or a TiledImage copy of it)
+template <class Source>
+static void WarpRows (const Source& source, const double inverse[6], int sampling_method, Image& dst,
+                      const std::vector<AffineWindow> *windows) {
+    int w = source.Width(), h = source.Height();
+
+    // how far the source position moves from one output pixel to the next along a row
+    int64_t du = llround(inverse[0] * FIXED_ONE);
+    int64_t dv = llround(inverse[3] * FIXED_ONE);
+
+    // bilinear positions are taken half a pixel back, onto the grid of pixel centers, and an extra 1/512 on,
+    // so cutting the position down to a whole number of 1/256ths rounds it.  Point positions are taken 1/512 on
+    // too, so a center that falls right on a pixel edge picks the same pixel whatever tiny error the map has
+    const int64_t half = (int64_t) 1 << (WARP_FRACTION_BITS - 1);
+    const int64_t bias = (int64_t) 1 << (WARP_FRACTION_BITS - 9);
+    const int64_t pointBias = sampling_method == IMAGE_SAMPLING_POINT ? bias : 0;
+
+    ParallelFor(0, dst.Height(), [&](int j0, int j1) {
+        for (int j = j0; j < j1; j++) {
+            Pixel *row = dst.Row(j);
+            int width = dst.Width();
+
+            // every method samples under the output pixel's center; point sampling takes the source pixel it's in
+            double u = inverse[0] * 0.5 + inverse[1] * (j + 0.5) + inverse[2];
+            double v = inverse[3] * 0.5 + inverse[4] * (j + 0.5) + inverse[5];
+            int64_t U = llround(u * FIXED_ONE) + pointBias, V = llround(v * FIXED_ONE) + pointBias;
+
+            // the pixels whose position is on the source, which is all Sample would check for
+            int begin = 0, end = width;
+            ClipSpan(U, du, 0, (int64_t) w << WARP_FRACTION_BITS, &begin, &end);
+            ClipSpan(V, dv, 0, (int64_t) h << WARP_FRACTION_BITS, &begin, &end);
+
+            for (size_t k = 0; windows != NULL && k < windows->size(); k++) {
+                const AffineWindow& window = (*windows)[k];
+                double x = window.m[1] * (j + 0.5) + window.m[0] * 0.5 + window.m[2];
+                double y = window.m[4] * (j + 0.5) + window.m[3] * 0.5 + window.m[5];
+                ClipSpan(llround(x * FIXED_ONE), llround(window.m[0] * FIXED_ONE), 0, (int64_t) window.width << WARP_FRACTION_BITS, &begin, &end);
+                ClipSpan(llround(y * FIXED_ONE), llround(window.m[3] * FIXED_ONE), 0, (int64_t) window.height << WARP_FRACTION_BITS, &begin, &end);
+            }
+
+            fill(row, row + begin, Pixel());
+            fill(row + end, row + width, Pixel());
+
+            switch (sampling_method) {
+                case IMAGE_SAMPLING_POINT: {
+                    int64_t x = U + begin * du, y = V + begin * dv;
+                    for (int i = begin; i < end; i++, x += du, y += dv) {
+                        row[i] = source.GetPixel((int) (x >> WARP_FRACTION_BITS), (int) (y >> WARP_FRACTION_BITS));
+                    }
+                    break;
+                }
+
+                case IMAGE_SAMPLING_BILINEAR: {
+                    int64_t X = U - half + bias, Y = V - half + bias;
+
+                    // in between, all 4 pixels are on the source
+                    int inner = begin, innerEnd = end;
+                    ClipSpan(X, du, 0, (int64_t) (w - 1) << WARP_FRACTION_BITS, &inner, &innerEnd);
+                    ClipSpan(Y, dv, 0, (int64_t) (h - 1) << WARP_FRACTION_BITS, &inner, &innerEnd);
+                    if (innerEnd == inner) {
+                        inner = innerEnd = end;
+                    }
+
+                    // the edge pixels stand in for any of the 4 that are off the source
+                    auto clamped = [&](int i0, int i1) {
+                        int64_t x = X + i0 * du, y = Y + i0 * dv;
+                        for (int i = i0; i < i1; i++, x += du, y += dv) {
+                            int x0 = (int) (x >> WARP_FRACTION_BITS), y0 = (int) (y >> WARP_FRACTION_BITS);
+                            int x1 = min(x0 + 1, w - 1), y1 = min(y0 + 1, h - 1);
+                            x0 = max(x0, 0);
+                            y0 = max(y0, 0);
+                            row[i] = BlendPixels(source.GetPixel(x0, y0), source.GetPixel(x1, y0),
+                                                 source.GetPixel(x0, y1), source.GetPixel(x1, y1),
+                                                 (int) (x >> (WARP_FRACTION_BITS - 8)) & 255, (int) (y >> (WARP_FRACTION_BITS - 8)) & 255);
+                        }
+                    };
+
+                    clamped(begin, inner);
+
+                    int64_t x = X + inner * du, y = Y + inner * dv;
+                    for (int i = inner; i < innerEnd; i++, x += du, y += dv) {
+                        int x0 = (int) (x >> WARP_FRACTION_BITS), y0 = (int) (y >> WARP_FRACTION_BITS);
+                        row[i] = BlendPixels(source.GetPixel(x0, y0), source.GetPixel(x0 + 1, y0),
+                                             source.GetPixel(x0, y0 + 1), source.GetPixel(x0 + 1, y0 + 1),
+                                             (int) (x >> (WARP_FRACTION_BITS - 8)) & 255, (int) (y >> (WARP_FRACTION_BITS - 8)) & 255);
+                    }
+
+                    clamped(innerEnd, end);
+                    break;
+                }
+
+                default:
+                    // anything else goes through SamplePixel
+                    for (int i = begin; i < end; i++) {
+                        row[i] = SamplePixel(source, u + i * inverse[0], v + i * inverse[3], sampling_method);
+                    }
+                    break;
+            }
+        }
+    });
+}
+
+
+void WarpAffine (const Image& src, const double m[6], int sampling_method, Image& dst,
+                 const std::vector<AffineWindow> *windows) {
+    double inverse[6];
+    bool invertible = InvertAffine(m, inverse);
+    assert(invertible);
+    (void) invertible;
+
+    // where output rows run nearly down the source's columns, each pixel along a row reads from a different
+    // source row, so the reads go to a tiled copy instead (see Tiled.h).  Short of about 75 degrees the rows
+    // still share enough cache lines that making the copy costs more than it saves
+    if (fabs(inverse[3]) > 0.97 * hypot(inverse[0], inverse[3])) {
+        TiledImage tiled(src);
+        WarpRows(tiled, inverse, sampling_method, dst, windows);
+    } else {
+        WarpRows(src, inverse, sampling_method, dst, windows);
+    }
+}
@@ -0,0 +1,64 @@
+//Warp.h
+//
+//Affine warps of a whole image
+//
+//  An affine map moves the source position by the same amount from one
+//  output pixel to the next along a row, so instead of working out every
+//  position with a matrix multiply (or sines and cosines), each row starts
+//  from its first position and steps along in fixed point.  Where a row
+//  runs off the source is worked out once per row, as the span of output
+//  pixels in between, so the pixels themselves don't check any bounds.
+
+#ifndef WARP_INCLUDED
+#define WARP_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "pixel.h"
+
+class Image;
+
+#define WARP_FRACTION_BITS 32       // bits of a fixed point coordinate after the point
+
+/**
+ * A canvas some earlier step of a fused warp left (see RunChain).  Whatever
+ * fell off it is gone, so output pixels whose position on it is off it are
+ * black, however much of the source is under them.
+ **/
+struct AffineWindow
+{
+    double m[6];            // the map from output positions to positions on the canvas
+    int width, height;
+};
+
+/**
+ * Fills dst with src warped by the affine map m: the source point (x, y)
+ * lands on (m[0] x + m[1] y + m[2], m[3] x + m[4] y + m[5]).  Every method
+ * samples under output pixel (i, j)'s center, (i + 0.5, j + 0.5); point
+ * sampling takes the source pixel that falls in, so a map that mirrors or
+ * turns the image picks the same pixels as one that doesn't.
+ * Bilinear weights are rounded to 1/256.  Anything off the source, or off
+ * any of the windows, is black.
+ * m has to be invertible.
+ **/
+void WarpAffine (const Image& src, const double m[6], int sampling_method, Image& dst,
+                 const std::vector<AffineWindow> *windows = NULL);
+
+// inverse = the map that undoes m; false if m squashes the image flat
+bool InvertAffine (const double m[6], double inverse[6]);
+
+// result = first followed by then (result can be either of them)
+void ComposeAffine (const double first[6], const double then[6], double result[6]);
+
+// The canvas Affine puts a w x h image on by default, out from the origin to wherever its corners land
+void AffineBounds (const double m[6], int w, int h, int *boundsWidth, int *boundsHeight);
+
+/**
+ * Narrows the output pixels [begin, end) of a row to the ones for which
+ * lo <= start + i * step < hi, all in fixed point.  end == begin if there
+ * aren't any.
+ **/
+void ClipSpan (int64_t start, int64_t step, int64_t lo, int64_t hi, int *begin, int *end);
+
+#endif